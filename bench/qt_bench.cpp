@@ -0,0 +1,190 @@
+// qt 端口二进制协议的压测客户端
+// 用法: qt_bench <ip> <port> [clients=8] [messages=10000] [ping|chat]
+// ping: 每个客户端发送 PING 并等待 PONG, 统计吞吐和往返延迟
+// chat: 每个客户端发送 CHAT, 统计服务器转发给其他所有客户端的吞吐
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "../include/QtProtocol.hpp"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static sockaddr_in server_addr;
+
+static int connect_server(){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0)
+        return -1;
+    if(connect(fd, (sockaddr*)&server_addr, sizeof(server_addr)) < 0){
+        close(fd);
+        return -1;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+static bool send_all(int fd, const std::string& data){
+    size_t off = 0;
+    while(off < data.size()){
+        ssize_t n = send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if(n <= 0)
+            return false;
+        off += n;
+    }
+    return true;
+}
+
+// 阻塞读取, 直到解码出一个帧
+static bool read_frame(int fd, QtFrameDecoder& decoder, qt_frame& frame){
+    char buffer[16384];
+    while(!decoder.next(frame)){
+        if(decoder.error())
+            return false;
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if(n <= 0)
+            return false;
+        decoder.feed(buffer, n);
+    }
+    return true;
+}
+
+static bool login(int fd, QtFrameDecoder& decoder, const std::string& name){
+    if(!send_all(fd, encode_qt_frame(QT_LOGIN, 0, name)))
+        return false;
+    qt_frame frame;
+    return read_frame(fd, decoder, frame) && frame.type == QT_LOGIN;
+}
+
+static void run_ping(int clients, int messages){
+    std::vector<std::vector<double>> rtts(clients);
+    std::atomic<int> failed(0);
+    std::vector<std::thread> threads;
+    auto start = bench_clock::now();
+    for(int i = 0; i < clients; ++i){
+        threads.emplace_back([i, messages, &rtts, &failed]{
+            int fd = connect_server();
+            QtFrameDecoder decoder;
+            if(fd < 0 || !login(fd, decoder, "bench" + std::to_string(i))){
+                ++failed;
+                if(fd >= 0)
+                    close(fd);
+                return;
+            }
+            rtts[i].reserve(messages);
+            qt_frame frame;
+            for(int m = 0; m < messages; ++m){
+                auto t0 = bench_clock::now();
+                if(!send_all(fd, encode_qt_frame(QT_PING, 0, "ping")) || !read_frame(fd, decoder, frame) || frame.type != QT_PONG){
+                    ++failed;
+                    break;
+                }
+                rtts[i].push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - t0).count());
+            }
+            close(fd);
+        });
+    }
+    for(auto& t : threads)
+        t.join();
+    double secs = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    std::vector<double> all;
+    for(auto& v : rtts)
+        all.insert(all.end(), v.begin(), v.end());
+    if(all.empty()){
+        printf("no successful round trips (%d clients failed)\n", failed.load());
+        return;
+    }
+    std::sort(all.begin(), all.end());
+    printf("ping: %zu round trips in %.2fs, %.0f msg/s, failed clients %d\n", all.size(), secs, all.size() / secs, failed.load());
+    printf("rtt us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+           all[all.size() / 2], all[all.size() * 9 / 10], all[all.size() * 99 / 100], all.back());
+}
+
+static void run_chat(int clients, int messages){
+    std::vector<int> fds(clients, -1);
+    std::vector<QtFrameDecoder> decoders(clients);
+    for(int i = 0; i < clients; ++i){
+        fds[i] = connect_server();
+        if(fds[i] < 0 || !login(fds[i], decoders[i], "chat" + std::to_string(i))){
+            fprintf(stderr, "client %d failed to connect or log in\n", i);
+            for(int fd : fds)
+                if(fd >= 0)
+                    close(fd);
+            return;
+        }
+    }
+
+    // 每个客户端应当收到其他所有客户端的全部消息
+    const long expected = (long)(clients - 1) * messages;
+    std::atomic<long> delivered(0);
+    std::vector<std::thread> readers, writers;
+    auto start = bench_clock::now();
+    for(int i = 0; i < clients; ++i){
+        readers.emplace_back([i, expected, &fds, &decoders, &delivered]{
+            qt_frame frame;
+            for(long got = 0; got < expected; ){
+                if(!read_frame(fds[i], decoders[i], frame))
+                    return;
+                if(frame.type == QT_CHAT){
+                    ++got;
+                    ++delivered;
+                }
+            }
+        });
+        writers.emplace_back([i, messages, &fds]{
+            std::string msg(32, 'x');
+            for(int m = 0; m < messages; ++m)
+                if(!send_all(fds[i], encode_qt_frame(QT_CHAT, 0, msg)))
+                    return;
+        });
+    }
+    for(auto& t : writers)
+        t.join();
+    double send_secs = std::chrono::duration<double>(bench_clock::now() - start).count();
+    // 读线程收齐全部消息或连接断开时退出
+    for(auto& t : readers)
+        t.join();
+    double secs = std::chrono::duration<double>(bench_clock::now() - start).count();
+    for(int fd : fds)
+        close(fd);
+
+    printf("chat: sent %ld msgs in %.2fs (%.0f msg/s)\n", (long)clients * messages, send_secs, clients * messages / send_secs);
+    printf("chat: delivered %ld / %ld in %.2fs (%.0f msg/s)\n", delivered.load(), expected * clients, secs, delivered.load() / secs);
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 3){
+        fprintf(stderr, "usage: %s <ip> <port> [clients=8] [messages=10000] [ping|chat]\n", argv[0]);
+        return 1;
+    }
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(atoi(argv[2]));
+    inet_aton(argv[1], &server_addr.sin_addr);
+    int clients = argc > 3 ? atoi(argv[3]) : 8;
+    int messages = argc > 4 ? atoi(argv[4]) : 10000;
+    std::string mode = argc > 5 ? argv[5] : "ping";
+    if(clients < 1 || messages < 1){
+        fprintf(stderr, "clients and messages must be positive\n");
+        return 1;
+    }
+
+    if(mode == "chat")
+        run_chat(clients, messages);
+    else
+        run_ping(clients, messages);
+    return 0;
+}
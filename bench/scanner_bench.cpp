@@ -0,0 +1,126 @@
+// HTTP 头部扫描器和请求解析器的微基准
+// 用法: scanner_bench [iterations=1000000]
+// 1. 各个 http_scanner 实现逐行扫描头部的吞吐
+// 2. HttpParser 分别使用各个实现解析整条请求, 以及原来基于 istringstream/getline 的解析作为对照
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sstream>
+#include <unordered_map>
+#include <chrono>
+
+#include "../include/HttpScanner.hpp"
+#include "../include/HttpParser.hpp"
+
+typedef std::chrono::steady_clock bench_clock;
+
+// main.cpp 中的示例请求, 浏览器典型的长 Accept 和 User-Agent
+static const std::string sample_request =
+    "GET /index.html?name=Alice&age=25 HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/133.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: en-GB,en;q=0.9,zh-CN;q=0.8,zh;q=0.7,en-US;q=0.6\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+// 防止编译器把结果优化掉
+static volatile size_t sink;
+
+// 原来的 parse_HttpRequest 的做法: getline 分行, find(": ") 分割, 每个字段一个 std::string
+static size_t legacy_parse(const std::string& request){
+    std::istringstream stream(request);
+    std::unordered_map<std::string, std::string> headers;
+    std::string line, method, url, version;
+    if(std::getline(stream, line)){
+        std::istringstream line_stream(line);
+        line_stream >> method >> url >> version;
+    }
+    while(std::getline(stream, line) && line != "\r"){
+        size_t pos = line.find(": ");
+        if(pos != std::string::npos){
+            std::string value = line.substr(pos + 2);
+            if(!value.empty() && value.back() == '\r')
+                value.pop_back();
+            headers[line.substr(0, pos)] = value;
+        }
+    }
+    return headers.size() + url.size();
+}
+
+static double seconds_since(bench_clock::time_point start){
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static void bench_scan(const http_scanner* s, long iterations){
+    const char* begin = sample_request.data();
+    const char* end = begin + sample_request.size();
+    size_t found = 0;
+    auto start = bench_clock::now();
+    for(long i = 0; i < iterations; ++i){
+        // 和解析器一样: 找头部名的 ':' , 再找值的行尾
+        const char* p = s->url(begin, end);
+        p = (const char*)memchr(p, '\n', end - p) + 1;
+        while(p < end && *p != '\r'){
+            p = s->key(p, end) + 1;
+            p = s->value(p, end);
+            found += *p == '\r';
+            p += 2;
+        }
+    }
+    double secs = seconds_since(start);
+    sink = found;
+    printf("  scan   %-8s %8.1f ns/request  %7.2f GB/s\n", s->name, secs * 1e9 / iterations,
+           sample_request.size() * (double)iterations / secs / 1e9);
+}
+
+static void bench_parse(const http_scanner* s, long iterations){
+    std::string buf = sample_request;
+    HttpParser parser;
+    parser.set_scanner(s);
+    size_t total = 0;
+    auto start = bench_clock::now();
+    for(long i = 0; i < iterations; ++i){
+        parser.reset();
+        if(parser.parse(&buf[0], buf.size()) != HTTP_PARSE_DONE){
+            fprintf(stderr, "parse failed with %s\n", s->name);
+            exit(1);
+        }
+        total += parser.request().header_count_;
+    }
+    double secs = seconds_since(start);
+    sink = total;
+    printf("  parse  %-8s %8.1f ns/request\n", s->name, secs * 1e9 / iterations);
+}
+
+int main(int argc, char* argv[]){
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+    if(iterations < 1)
+        iterations = 1;
+    printf("request %zu bytes, %ld iterations, default scanner: %s\n",
+           sample_request.size(), iterations, default_http_scanner()->name);
+
+    const scanner_impl impls[] = {SCANNER_SCALAR, SCANNER_SSE42, SCANNER_AVX2};
+    for(scanner_impl impl : impls){
+        const http_scanner* s = get_http_scanner(impl);
+        if(s)
+            bench_scan(s, iterations);
+    }
+    for(scanner_impl impl : impls){
+        const http_scanner* s = get_http_scanner(impl);
+        if(s)
+            bench_parse(s, iterations);
+    }
+
+    long legacy_iterations = iterations / 10 > 0 ? iterations / 10 : 1;
+    size_t total = 0;
+    auto start = bench_clock::now();
+    for(long i = 0; i < legacy_iterations; ++i)
+        total += legacy_parse(sample_request);
+    double secs = seconds_since(start);
+    sink = total;
+    printf("  parse  %-8s %8.1f ns/request\n", "legacy", secs * 1e9 / legacy_iterations);
+    return 0;
+}
@@ -0,0 +1,218 @@
+// 线程池任务吞吐的微基准, 对比工作窃取线程池和原来单锁单队列的线程池,
+// 以及工作窃取线程池的两种提交方式: add_task (返回 future) 和 post (不分配内存)
+// 用法: threadpool_bench [max_threads=硬件线程数] [tasks=200000] [work=200]
+// 线程数从 1 开始每次翻倍直到 max_threads, 每个线程数下测两种负载:
+// inject: 一个外部线程 (相当于 reactor) 提交所有任务
+// spawn: 外部线程只提交少量根任务, 其余任务在工作线程内部提交
+// work 为每个任务空转的循环次数, work=0 时的结果主要反映每个任务的调度开销
+// 最后在 max_threads 个线程下测混合负载的延迟: 队列中积压大量长任务 (相当于静态文件读取) 时,
+// 每毫秒提交一个短任务 (相当于聊天帧), 分别以普通和高优先级提交, 统计从提交到开始执行的延迟
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <queue>
+#include <vector>
+#include <algorithm>
+
+#include "../include/ThreadPool.hpp"
+
+typedef std::chrono::steady_clock bench_clock;
+
+// 原来的实现: 一把锁保护一个队列, 提交和取任务都要竞争这把锁
+class LockedPool{
+
+    public:
+    explicit LockedPool(int n) : stop_(false){
+        for(int i = 0; i < n; ++i){
+            threads_.emplace_back([this]{
+                while(true){
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> ulk(mtx_);
+                        cond_.wait(ulk, [this]{ return stop_ || !tasks_.empty(); });
+                        if(stop_)
+                            return;
+                        task = std::move(tasks_.front());
+                        tasks_.pop();
+                    }
+                    task();
+                }
+            });
+        }
+    }
+
+    ~LockedPool(){
+        {
+            std::lock_guard<std::mutex> lg(mtx_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        for(std::thread& t : threads_)
+            t.join();
+    }
+
+    template <typename func, typename... Args>
+    std::future<typename std::result_of<func(Args...)>::type> add_task(func&& function, Args&&... args){
+        using return_type = typename std::result_of<func(Args...)>::type;
+        using task = std::packaged_task<return_type()>;
+        auto task_ = std::make_shared<task>(std::bind(std::forward<func>(function), std::forward<Args>(args)...));
+        auto ret = task_->get_future();
+        {
+            std::lock_guard<std::mutex> lg(mtx_);
+            tasks_.emplace([task_]{ (*task_)(); });
+        }
+        cond_.notify_one();
+        return ret;
+    }
+
+    private:
+    bool stop_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::queue<std::function<void()>> tasks_;
+    std::vector<std::thread> threads_;
+};
+
+static int work_loops = 200;
+static std::atomic<long> done(0);
+
+static void spin_work(){
+    volatile int x = 0;
+    for(int i = 0; i < work_loops; ++i)
+        x = x + i;
+}
+
+static void leaf_task(){
+    spin_work();
+    done.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void wait_done(long tasks){
+    while(done.load(std::memory_order_relaxed) < tasks)
+        std::this_thread::yield();
+}
+
+// 两种提交方式, LockedPool 只有 add_task
+template <typename Pool, typename F>
+static void submit(Pool& pool, bool post, F&& f){
+    pool.add_task(std::forward<F>(f));
+}
+
+template <typename F>
+static void submit(ThreadPool& pool, bool post, F&& f){
+    if(post)
+        pool.post(std::forward<F>(f));
+    else
+        pool.add_task(std::forward<F>(f));
+}
+
+template <typename Pool>
+static double run_inject(Pool& pool, long tasks, bool post){
+    done.store(0);
+    auto start = bench_clock::now();
+    for(long i = 0; i < tasks; ++i)
+        submit(pool, post, leaf_task);
+    wait_done(tasks);
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// 每个根任务在工作线程中提交 fanout 个叶子任务
+template <typename Pool>
+static void root_task(Pool* pool, long fanout, bool post){
+    for(long i = 0; i < fanout; ++i)
+        submit(*pool, post, leaf_task);
+    spin_work();
+    done.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename Pool>
+static double run_spawn(Pool& pool, long tasks, bool post){
+    const long roots = 64;
+    long fanout = tasks / roots - 1;
+    done.store(0);
+    auto start = bench_clock::now();
+    for(long i = 0; i < roots; ++i)
+        submit(pool, post, [&pool, fanout, post]{ root_task(&pool, fanout, post); });
+    wait_done(roots * (fanout + 1));
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static void busy_for(std::chrono::microseconds us){
+    auto end = bench_clock::now() + us;
+    while(bench_clock::now() < end){}
+}
+
+// 返回短任务延迟的 p50 和 p99 (微秒)
+static void run_latency(int threads, task_priority priority, double* p50, double* p99){
+    const int samples = 200;
+    const long backlog = 1000L * threads;
+    std::vector<double> latency(samples);
+    std::atomic<int> measured(0);
+    ThreadPool pool(threads);
+    // 积压的长任务足够覆盖整个测量过程
+    for(long i = 0; i < backlog; ++i)
+        pool.post([]{ busy_for(std::chrono::microseconds(500)); });
+    for(int i = 0; i < samples; ++i){
+        auto submitted = bench_clock::now();
+        pool.post([i, submitted, &latency, &measured]{
+            latency[i] = std::chrono::duration<double, std::micro>(bench_clock::now() - submitted).count();
+            measured.fetch_add(1, std::memory_order_release);
+        }, priority);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    while(measured.load(std::memory_order_acquire) < samples)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    pool.stop();
+    std::sort(latency.begin(), latency.end());
+    *p50 = latency[samples / 2];
+    *p99 = latency[samples * 99 / 100];
+}
+
+int main(int argc, char* argv[]){
+    int max_threads = argc > 1 ? atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+    long tasks = argc > 2 ? atol(argv[2]) : 200000;
+    work_loops = argc > 3 ? atoi(argv[3]) : 200;
+    if(max_threads < 1 || tasks < 128 || work_loops < 0){
+        fprintf(stderr, "usage: %s [max_threads] [tasks>=128] [work]\n", argv[0]);
+        return 1;
+    }
+
+    // 每种负载三列: 原来的线程池, 工作窃取 + add_task, 工作窃取 + post
+    printf("%-8s %14s %14s %14s %14s %14s %14s\n", "threads",
+        "locked inj", "add_task inj", "post inj", "locked spawn", "add_task spawn", "post spawn");
+    for(int n = 1; ; n = n * 2 > max_threads && n < max_threads ? max_threads : n * 2){
+        double r[6];
+        {
+            LockedPool pool(n);
+            r[0] = tasks / run_inject(pool, tasks, false);
+            r[3] = tasks / run_spawn(pool, tasks, false);
+        }
+        {
+            ThreadPool pool(n);
+            r[1] = tasks / run_inject(pool, tasks, false);
+            r[2] = tasks / run_inject(pool, tasks, true);
+            r[4] = tasks / run_spawn(pool, tasks, false);
+            r[5] = tasks / run_spawn(pool, tasks, true);
+        }
+        printf("%-8d", n);
+        for(int i = 0; i < 6; ++i)
+            printf(" %12.0f/s", r[i]);
+        printf("\n");
+        if(n >= max_threads)
+            break;
+    }
+
+    printf("\nshort task latency behind a backlog of 500us tasks, %d threads\n", max_threads);
+    const char* names[PRIORITY_COUNT] = {"high", "normal"};
+    for(int p = PRIORITY_COUNT - 1; p >= 0; --p){
+        double p50, p99;
+        run_latency(max_threads, (task_priority)p, &p50, &p99);
+        printf("%-8s p50 %10.0fus   p99 %10.0fus\n", names[p], p50, p99);
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef AFFINITY_HPP
+#define AFFINITY_HPP
+
+#include <vector>
+#include <thread>
+#include <utility>
+
+// CPU 亲和性和 NUMA 拓扑, 从 /sys/devices/system/node 读取, 不依赖 libnuma
+// 没有 NUMA 信息时所有 CPU 都视为在节点 0
+
+// 本进程允许运行的 CPU, 按 NUMA 节点交错排列 (节点 0 的第一个, 节点 1 的第一个, 节点 0 的第二个, ...),
+// 按顺序分配给线程时各节点的线程数均衡
+std::vector<int> placement_cpus();
+// CPU 所在的 NUMA 节点
+int cpu_node(int cpu);
+int numa_node_count();
+
+// 把当前线程绑定到一个 CPU, 失败时打印错误并返回 false
+bool pin_thread(int cpu);
+
+// 在绑定到 cpu 的临时线程中执行 f 并等待它结束
+// Linux 按首次访问分配物理页, 在这里分配并初始化的内存位于 cpu 所在的 NUMA 节点
+template <typename F>
+void run_on_cpu(int cpu, F&& f){
+    std::thread t([cpu, &f]{
+        pin_thread(cpu);
+        f();
+    });
+    t.join();
+}
+
+#endif
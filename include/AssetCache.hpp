@@ -0,0 +1,87 @@
+#ifndef ASSETCACHE_HPP
+#define ASSETCACHE_HPP
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "../include/ContentEncoding.hpp"
+
+// 缓存的一个文件版本: 每种内容编码一份完整的 200 响应, 以及条件请求需要的校验信息
+struct cached_asset{
+    // 下标为 content_coding, 为空表示没有这种编码的版本
+    std::string responses[CODING_COUNT];
+    std::string etags[CODING_COUNT];
+    std::string last_modified;
+    time_t mtime;
+    // 可压缩的类型, 所有版本和 304 都带 Vary: Accept-Encoding
+    bool vary;
+
+    size_t size() const{
+        size_t n = 0;
+        for(const std::string& r : responses)
+            n += r.size();
+        return n;
+    }
+};
+
+// 小文件的完整响应缓存: 状态行, 头部和响应体预先拼好放在一块连续的缓冲区中, 命中时整块发送,
+// 不再打开文件, 查 MIME 类型或格式化响应
+// 读多写少: 读者原子地取得当前表的快照, 不加锁; 插入和失效在锁内复制一份新表再原子替换
+// 文件所在目录用 inotify 监视, 文件或它的预压缩版本 (.gz / .br) 被修改, 替换或删除时使对应的项失效,
+// 由 reactor 0 调用 handle_events
+class AssetCache{
+
+    public:
+    // 只缓存不超过 max_file_size 的文件, 所有编码版本的总大小超过 max_total 后不再插入
+    explicit AssetCache(size_t max_file_size = 256 * 1024, size_t max_total = 16 * 1024 * 1024);
+    ~AssetCache();
+
+    AssetCache(const AssetCache&) = delete;
+    AssetCache& operator=(const AssetCache&) = delete;
+
+    // 创建 inotify 实例, 失败时缓存不启用, 所有查找都未命中
+    bool init();
+    int notify_fd() const { return inotify_fd_; }
+    bool enabled() const { return inotify_fd_ >= 0; }
+    size_t max_file_size() const { return max_file_size_; }
+
+    // key 为请求的 URL
+    std::shared_ptr<const cached_asset> find(std::string_view key) const;
+
+    // 读文件之前调用: 开始监视文件所在的目录, 返回当前的失效计数
+    // 失效计数与 insert 时不同说明读文件期间发生过失效, 这次读到的内容不插入
+    bool watch(const std::string& path, uint64_t* generation);
+    void insert(std::string_view key, const std::string& path, std::shared_ptr<const cached_asset> asset, uint64_t generation);
+
+    // 读出所有 inotify 事件并使相关的项失效
+    void handle_events();
+    void invalidate(const std::string& path);
+
+    private:
+    struct asset{
+        std::string path;
+        std::shared_ptr<const cached_asset> data;
+    };
+    typedef std::unordered_map<std::string, asset> asset_map;
+
+    size_t max_file_size_;
+    size_t max_total_;
+    int inotify_fd_;
+    // 只能通过 std::atomic_load / std::atomic_store 访问
+    std::shared_ptr<const asset_map> assets_;
+    // 保护下面的成员和 assets_ 的替换
+    std::mutex mtx_;
+    size_t total_;
+    uint64_t generation_;
+    std::unordered_map<int, std::string> watch_dirs_;
+    std::unordered_map<std::string, int> dir_watches_;
+};
+
+extern AssetCache asset_cache;
+
+#endif
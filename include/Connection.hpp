@@ -0,0 +1,211 @@
+#ifndef CONNECTION_HPP
+#define CONNECTION_HPP
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include "../include/Poller.hpp"
+#include "../include/TimingWheel.hpp"
+#include "../include/QtProtocol.hpp"
+#include "../include/HttpParser.hpp"
+#include "../include/FileCache.hpp"
+
+enum connProto{
+    HTTP,
+    WEBSOCKET,
+    QT,
+    OTHER
+};
+
+// 连接超时配置, 由 server 构造时从 server_options 设置
+struct timeout_config{
+    uint64_t header_ms;
+    uint64_t idle_ms;
+    uint64_t ws_idle_ms;
+    uint64_t write_ms;
+};
+
+extern timeout_config conn_timeouts;
+
+// 注册到 poller 中的用户数据: 高 32 位为槽位代数, 低 32 位为槽位下标(即 fd)
+// 连接的代数从 1 开始, 监听套接字等不在连接表中的 fd 用代数 0 注册, 不会与连接冲突
+typedef uint64_t conn_handle;
+
+inline conn_handle make_handle(int fd, uint32_t gen){ return ((uint64_t)gen << 32) | (uint32_t)fd; }
+inline int handle_fd(conn_handle h){ return (int)(uint32_t)h; }
+inline uint32_t handle_gen(conn_handle h){ return (uint32_t)(h >> 32); }
+
+// 输出队列中的一段待发送数据, 三种之一:
+// 自有的 data; 共享的 body (例如缓存的内容, 发送时不复制); 文件的 [offset, end) 区间, 由 sendfile 发送
+// offset 为已经发送到的位置, 内存段从 0 开始, 文件段从区间起点开始
+struct out_chunk{
+    std::string data;
+    std::shared_ptr<const std::string> body;
+    std::shared_ptr<const open_file> file;
+    size_t offset;
+    size_t end;
+
+    explicit out_chunk(std::string&& d) : data(std::move(d)), offset(0), end(0){};
+    explicit out_chunk(std::shared_ptr<const std::string> b) : body(std::move(b)), offset(0), end(0){};
+    out_chunk(std::shared_ptr<const open_file> f, size_t begin, size_t last) : file(std::move(f)), offset(begin), end(last){};
+
+    const char* bytes() const { return body ? body->data() : data.data(); }
+    size_t size() const { return file ? end : body ? body->size() : data.size(); }
+};
+
+class connection{
+    public:
+    static const uint64_t NO_DEADLINE = UINT64_MAX;
+
+    int fd;
+    // 槽位代数, 与 ConnectionTable 中的一致时连接仍然有效
+    std::atomic<uint32_t> gen;
+    // 连接表持有一个引用, 工作线程处理期间各持有一个, 归零时才关闭 fd 并放回对象池
+    std::atomic<uint32_t> refs;
+    connProto conn_type;
+    // 登录后才有, 由 conn_mtx 保护
+    std::string username;
+    uint32_t user_id;
+    // 接收缓冲区从当前请求的第一个字节开始, 解析器的状态在多次读之间保留
+    std::string in_buf;
+    HttpParser http_parser;
+    // WebSocket 分片消息: 已收到的分片和第一个分片的 opcode, 没有未完成的消息时为 0
+    std::string ws_message;
+    uint8_t ws_msg_opcode;
+    // qt 端口的连接在多次读之间保留不完整的帧
+    QtFrameDecoder qt_decoder;
+    // 所属 reactor 的 poller, 连接始终留在 accept 它的 reactor 上
+    Poller* poller;
+    // 由所属 reactor 的时间轮管理, 到期时检查 deadline, 未到期就按 deadline 重新调度
+    // 工作线程只需要更新 deadline, 不需要操作时间轮
+    timer_node timer;
+    std::atomic<uint64_t> deadline;
+    // HTTP: 缓冲区中不完整请求的第一个字节到达的时间, 没有时为 0
+    // 由处理任务写入, 任务结束时据此设置 header 超时, 之后陆续到达的字节不会推迟期限
+    uint64_t request_start;
+    // true: EPOLLONESHOT 注册, 每个任务结束时重新注册
+    // false: 只注册一次 EPOLLIN | EPOLLOUT | EPOLLET, 由 sched 状态保证同一时刻只有一个任务
+    bool oneshot;
+    connection(int f = -1, connProto t = OTHER, Poller* p = nullptr) : fd(f), gen(0), refs(0), conn_type(t), username(), user_id(0), in_buf(), http_parser(), ws_message(), ws_msg_opcode(0), qt_decoder(), poller(p), timer(), deadline(NO_DEADLINE), request_start(0), oneshot(true), sched(IDLE), busy(false), shutdown_after_flush(false), closed(false), input_closed(false){ timer.data = this; };
+
+    conn_handle handle() const { return make_handle(fd, gen.load(std::memory_order_relaxed)); }
+
+    void touch(uint64_t timeout_ms){
+        deadline.store(timeout_ms ? TimingWheel::now_ms() + timeout_ms : NO_DEADLINE, std::memory_order_release);
+    }
+
+    // 非阻塞发送: 能直接写就写, 剩余部分进入输出队列, 内核缓冲区满时才注册 EPOLLOUT
+    // 任何线程都可以调用, 返回 false 表示连接出错
+    bool send(std::string&& data);
+    bool send(const void* data, size_t len);
+    // 一次加锁把多段数据放入输出队列, 合并成尽量少的 sendmsg; 用于流水线请求的一批响应
+    bool send(std::vector<out_chunk>&& parts);
+
+    // reactor 收到 EPOLLIN 时调用, 已有任务在执行或者不再读取时返回 false
+    // 持久注册时, 执行中的任务会被标记为需要再处理一次
+    bool begin_task();
+    // 工作线程处理完后调用, oneshot 时负责重新注册; shutdown_wr 在输出队列发送完后关闭写端,
+    // 之后不再读取, 只等输出发完和对端关闭 (EPOLLHUP)
+    // 返回 false 表示执行期间又收到了数据(只在持久注册时发生), 调用者应当继续处理
+    bool end_task(bool shutdown_wr = false);
+    // reactor 收到 EPOLLOUT 时调用, 返回 false 表示连接出错
+    bool on_writable(bool rearm);
+    // reactor 关闭连接时调用, 之后 send 失败, end_task 也不再重新注册
+    void mark_closed();
+    bool is_closed();
+
+    private:
+    friend class ConnectionTable;
+
+    // 持久注册时的调度状态: 空闲 / 任务执行中 / 执行中又收到了事件
+    enum sched_state : uint8_t{
+        IDLE,
+        RUNNING,
+        NOTIFIED
+    };
+    std::atomic<uint8_t> sched;
+    bool flush_locked();
+    bool send_locked();
+    void rearm_locked();
+    uint64_t idle_timeout() const;
+    void reset_deadline_locked();
+
+    // 保护输出队列和下面的状态
+    std::mutex out_mtx;
+    std::deque<out_chunk> out_queue;
+    // 有任务在线程池中执行, 此时由任务结束时重新注册 fd
+    bool busy;
+    bool shutdown_after_flush;
+    bool closed;
+    // 对端已关闭或本端决定关闭, 不再处理新数据; reactor 不加锁读取
+    std::atomic<bool> input_closed;
+};
+
+// 以 fd 为下标的连接表, 槽位数取 RLIMIT_NOFILE, 启动时一次性分配
+// 每个槽有代数, 每次 open/close 加一, 事件和任务只携带 conn_handle, 用之前通过 acquire 校验
+// 连接对象来自只增不减的对象池, 引用计数归零后才回收, 所以 acquire 读到已回收的对象也是安全的;
+// fd 也推迟到引用归零时才关闭, 在此之前内核不会把同一个 fd 号分配给新连接
+class ConnectionTable{
+
+    public:
+    explicit ConnectionTable(size_t capacity = 0);
+    ~ConnectionTable();
+
+    ConnectionTable(const ConnectionTable&) = delete;
+    ConnectionTable& operator=(const ConnectionTable&) = delete;
+
+    // 只由 accept 这个 fd 的 reactor 调用, fd 超出表的范围时返回 nullptr
+    connection* open(int fd, connProto type, Poller* poller);
+    // 使槽位上的句柄失效并放弃表的引用, 调用前要先从 poller 和时间轮中移除
+    void close(int fd);
+
+    // 句柄仍然有效时增加引用并返回连接, 连接已关闭或 fd 已被复用时返回 nullptr
+    connection* acquire(conn_handle h);
+    void release(connection* conn);
+
+    size_t capacity() const { return capacity_; }
+
+    private:
+    struct slot{
+        std::atomic<connection*> conn;
+        std::atomic<uint32_t> gen;
+        slot() : conn(nullptr), gen(0){};
+    };
+
+    void recycle(connection* conn);
+
+    size_t capacity_;
+    std::unique_ptr<slot[]> slots_;
+    // 对象池, 表析构时才释放
+    std::mutex pool_mtx_;
+    std::vector<connection*> free_;
+    std::vector<connection*> all_;
+};
+
+// 作用域内持有一个连接引用
+class conn_ref{
+
+    public:
+    conn_ref(ConnectionTable& table, conn_handle h) : table_(table), conn_(table.acquire(h)){};
+    ~conn_ref(){ if(conn_) table_.release(conn_); }
+
+    conn_ref(const conn_ref&) = delete;
+    conn_ref& operator=(const conn_ref&) = delete;
+
+    connection* get() const { return conn_; }
+    connection* operator->() const { return conn_; }
+    explicit operator bool() const { return conn_ != nullptr; }
+
+    private:
+    ConnectionTable& table_;
+    connection* conn_;
+};
+
+#endif
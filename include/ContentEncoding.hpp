@@ -0,0 +1,30 @@
+#ifndef CONTENTENCODING_HPP
+#define CONTENTENCODING_HPP
+
+#include <string>
+#include <string_view>
+
+// 响应体的内容编码, 按优先级从低到高排列: 客户端给出的 q 值相同时选编号大的
+enum content_coding {
+    CODING_IDENTITY = 0,
+    CODING_GZIP,
+    CODING_BR,
+    CODING_COUNT
+};
+
+// Content-Encoding 的值, 以及预压缩文件的后缀 (.gz / .br), identity 为空
+const char* coding_name(content_coding coding);
+const char* coding_suffix(content_coding coding);
+
+// 按 Accept-Encoding 从 available 中选出 q 值最高的编码, 都不可接受时返回 identity
+content_coding negotiate_coding(std::string_view accept_encoding, const bool available[CODING_COUNT]);
+
+// 文本类的内容值得压缩, 图片 (除了 svg 和 ico), 音视频和压缩包不值得
+bool compressible_mime(std::string_view mime_type);
+
+// 本进程能否即时压缩; brotli 需要编译时定义 HAVE_BROTLI
+bool can_compress(content_coding coding);
+// 压缩失败或不支持时返回 false
+bool compress_body(content_coding coding, std::string_view in, std::string& out);
+
+#endif
@@ -2,12 +2,13 @@
 #define EPOLLWRAPPER_HPP
 
 #include "../include/tinystl/vector.h"
+#include "../include/Poller.hpp"
 
 #include <sys/epoll.h>
 #include <unistd.h>
 #include <assert.h>
 
-class EpollWrapper{
+class EpollWrapper : public Poller{
 
     public:
     EpollWrapper();
@@ -16,13 +17,14 @@ class EpollWrapper{
     EpollWrapper(const EpollWrapper&) = delete;
     EpollWrapper& operator=(const EpollWrapper&) = delete;
 
-    bool add_fd(int fd, uint32_t events);
-    bool add_fd(void* conn, int fd, uint32_t events);
-    bool mod_fd(int fd, uint32_t events);
-    bool mod_fd(void* conn, int fd, uint32_t events);
-    bool del_fd(int fd);
-    int wait();
-    mystl::vector<epoll_event>::iterator get_events();
+    bool add_fd(int fd, uint32_t events) override;
+    bool add_fd(uint64_t data, int fd, uint32_t events) override;
+    bool mod_fd(int fd, uint32_t events) override;
+    bool mod_fd(uint64_t data, int fd, uint32_t events) override;
+    bool del_fd(int fd) override;
+    int wait(int timeout = -1) override;
+    mystl::vector<epoll_event>::iterator get_events() override;
+    const char* name() const override { return "epoll"; }
 
     private:
     int epfd_;
@@ -0,0 +1,76 @@
+#ifndef FILECACHE_HPP
+#define FILECACHE_HPP
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// 打开的静态文件和打开时的 fstat 信息, 由 sendfile 直接从 fd 发送, 内容不经过用户态
+// 最后一个引用 (缓存或输出队列中的发送任务) 释放时关闭 fd
+struct open_file{
+    int fd;
+    std::string path;
+    std::string mime_type;
+    // 打开时根据 inode, 大小和纳秒级 mtime 生成, 文件的每个版本计算一次
+    std::string etag;
+    std::string last_modified;
+    size_t size;
+    struct timespec mtime;
+    ino_t ino;
+    dev_t dev;
+
+    open_file() : fd(-1), size(0), mtime(), ino(0), dev(0){};
+    ~open_file();
+
+    open_file(const open_file&) = delete;
+    open_file& operator=(const open_file&) = delete;
+};
+
+// 以路径为键的 LRU 缓存, 保存打开的 fd, 工作线程共享, 由一把锁保护
+// 超过 capacity 时淘汰最久未使用的项; 被淘汰的文件如果还在发送, 由发送方持有的引用保证 fd 有效
+// 命中时每隔 revalidate_ms 重新 stat 一次路径, 文件被替换或修改后重新打开
+class FileCache{
+
+    public:
+    explicit FileCache(size_t capacity = 128, uint64_t revalidate_ms = 1000);
+
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    // 只打开普通文件, 不存在或不可读时返回 nullptr
+    std::shared_ptr<const open_file> open(const std::string& path);
+    // 文件已知被修改时由 AssetCache 的 inotify 事件调用
+    void erase(const std::string& path);
+    void clear();
+    size_t size();
+
+    private:
+    struct entry{
+        std::shared_ptr<const open_file> file;
+        uint64_t checked_ms;
+        std::list<std::string>::iterator lru;
+    };
+
+    static std::shared_ptr<const open_file> open_path(const std::string& path);
+
+    size_t capacity_;
+    uint64_t revalidate_ms_;
+    std::mutex mtx_;
+    // 表头是最近使用的
+    std::list<std::string> lru_;
+    std::unordered_map<std::string, entry> entries_;
+};
+
+extern FileCache file_cache;
+
+// 用 pread 读出整个文件, 不影响其他线程对同一个 fd 的 sendfile
+bool read_open_file(const open_file& file, std::string& out);
+// 重新 stat 路径, 与打开时的 fstat 信息一致时返回 true
+bool open_file_current(const open_file& file);
+
+#endif
@@ -4,7 +4,10 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <map>
+#include <vector>
+#include <memory>
 #include <unordered_map>
 #include <openssl/sha.h>
 #include <openssl/evp.h>
@@ -12,6 +15,7 @@
 #include <openssl/buffer.h>
 
 #include "../include/file_utils.hpp"
+#include "../include/FileCache.hpp"
 #include "../include/myjson.hpp"
 
 enum ProcessState {
@@ -119,43 +123,109 @@ const std::unordered_map<std::string, std::string> file_path = {
 };
 
 // Http Request
+// 请求中的字符串都是指向连接接收缓冲区的 string_view, 头部和查询参数放在定长数组中,
+// 解析一个普通请求不分配堆内存; 只在处理请求期间有效, 缓冲区被修改后失效
+const size_t HTTP_MAX_HEADERS = 32;
+const size_t HTTP_MAX_QUERY_PARAMS = 16;
+const size_t HTTP_MAX_ROUTE_PARAMS = 8;
+
+struct http_field{
+    std::string_view key;
+    std::string_view value;
+};
+
 struct HttpRequest{
     HttpMethod method_;
     HttpVersion version_;
-    std::string url_;
-    std::unordered_map<std::string, std::string> query_params_;
-    std::unordered_map<std::string, std::string> headers_;
-    bool keep_alive_;
-    std::string body;
+    std::string_view url_;      // 不含查询串
+    http_field query_params_[HTTP_MAX_QUERY_PARAMS];
+    size_t query_count_;
+    http_field headers_[HTTP_MAX_HEADERS];
+    size_t header_count_;
+    bool keep_alive_;           // 按版本和 Connection 头判断的持久连接
+    std::string_view body;
+    // 路由中 :name 和 *name 匹配到的路径片段, 由 HttpRouter 填写
+    http_field route_params_[HTTP_MAX_ROUTE_PARAMS];
+    size_t route_param_count_;
+
+    HttpRequest() : method_(HttpMethod::UNKNOWN), version_(HttpVersion::UNKNOW), query_count_(0), header_count_(0), keep_alive_(false), route_param_count_(0){};
+
+    // 头部名不区分大小写, 不存在时返回空
+    const http_field* find_header(std::string_view key) const;
+    bool has_header(std::string_view key) const { return find_header(key) != nullptr; }
+    std::string_view header(std::string_view key) const;
+    std::string_view query(std::string_view key) const;
+    bool has_query(std::string_view key) const;
+    std::string_view param(std::string_view key) const;
 };
 
-void parse_url(HttpRequest& request, const std::string& url);
-HttpRequest parse_HttpRequest(const std::string& request);
-std::string url_to_filePath(const std::string& url);
+// 就地解码 %xx 和 '+', 返回解码后的长度
+size_t url_decode(char* s, size_t len);
+// url 指向可写的缓冲区, 查询参数的值在原处解码
+void parse_url(HttpRequest& request, char* url, size_t len);
+// 返回的请求引用 request 中的数据 (查询参数在原处解码)
+HttpRequest parse_HttpRequest(std::string& request);
+std::string url_to_filePath(std::string_view url);
 std::string get_mime_type(const std::string &filename);
 
+// IMF-fixdate, 例如 "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string http_date(time_t t);
+bool parse_http_date(std::string_view s, time_t* t);
+// 条件请求: 有 If-None-Match 时只比较 ETag, 否则比较 If-Modified-Since; 返回 true 表示应当回复 304
+bool request_not_modified(const HttpRequest& request, std::string_view etag, time_t mtime);
+
 std::string formatHttpRequest(const HttpRequest& request);
 
 std::string calculate_websocket_accept(const std::string& key);
 
+// 响应体的一段: 内存中的数据, 或者打开的文件的 [begin, end) 区间
+struct body_part{
+    std::shared_ptr<const std::string> data;
+    std::shared_ptr<const open_file> file;
+    size_t begin;
+    size_t end;
+    size_t size() const { return file ? end - begin : data->size(); }
+};
+
 // Http Response
+// 响应头部和响应体分开保存: write_head 只格式化状态行和头部, 响应体作为单独的几段由 writev 发送,
+// 不会被拼接到头部后面; 内存中的响应体用 shared_ptr 保存, 缓存的内容可以被多个响应共享
+// 文件区间由 sendfile 发送, 不读入内存; multipart/byteranges 由内存段和文件段交替组成
 class HttpResponse{
     public:
-    HttpResponse() : version_("HTTP/1.1"), status_code_(200), reason_phrase_("OK") {}
+    HttpResponse() : version_("HTTP/1.1"), status_code_(200), reason_phrase_("OK"), body_size_(0) {}
 
     void set_version(const std::string& version);
     void set_statusCode(int code);
     void set_reasonPhrase(const std::string& reason);
+    // 同名头部会被替换, 按设置的顺序输出
     void set_header(const std::string& key, const std::string& value);
+    // set_* 替换整个响应体, append_* 在响应体末尾追加一段
     void set_body(const std::string& body);
-    std::string HttpResponse_to_string() const;
+    void set_body(std::string&& body);
+    void set_body(std::shared_ptr<const std::string> body);
+    void set_file(std::shared_ptr<const open_file> file) { size_t n = file->size; set_file(std::move(file), 0, n); }
+    void set_file(std::shared_ptr<const open_file> file, size_t begin, size_t end);
+    void append_body(std::shared_ptr<const std::string> body);
+    void append_file(std::shared_ptr<const open_file> file, size_t begin, size_t end);
+    // 预先拼好的完整响应 (状态行 + 头部 + 响应体), 设置后原样发送, 其他字段都不再使用
+    void set_prebuilt(std::shared_ptr<const std::string> response) { prebuilt_ = std::move(response); }
+
+    int statusCode() const { return status_code_; }
+    const std::vector<body_part>& body() const { return body_; }
+    const std::shared_ptr<const std::string>& prebuilt() const { return prebuilt_; }
+    size_t body_size() const { return body_size_; }
+    // 把状态行和头部(含结尾的空行)追加到 out, 没有设置 Content-Length 时按响应体大小补上
+    void write_head(std::string& out) const;
 
     private:
     std::string version_;
     int status_code_;       // e.g. 200
     std::string reason_phrase_;  // e.g. "OK"
-    std::unordered_map<std::string, std::string> headers_;
-    std::string body_;
+    std::vector<std::pair<std::string, std::string>> headers_;
+    std::vector<body_part> body_;
+    size_t body_size_;
+    std::shared_ptr<const std::string> prebuilt_;
 };
 
 HttpResponse make_ok_response(const HttpRequest& http_request_);
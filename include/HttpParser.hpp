@@ -0,0 +1,92 @@
+#ifndef HTTPPARSER_HPP
+#define HTTPPARSER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "../include/HttpData.hpp"
+#include "../include/HttpScanner.hpp"
+
+enum HttpParseResult {
+    HTTP_PARSE_AGAIN = 0,   // 请求还不完整, 等待更多数据
+    HTTP_PARSE_DONE,        // 解析出一个完整请求, consumed() 为它占用的字节数
+    HTTP_PARSE_ERROR
+};
+
+// 请求行和头部的最大长度, 超过时视为错误, 防止缓冲区无限增长
+const size_t HTTP_MAX_HEADER_SIZE = 64 * 1024;
+const size_t HTTP_MAX_BODY_SIZE = 16 * 1024 * 1024;
+
+// 可恢复的 HTTP/1.1 请求解析器, 每个连接一个
+// 按 ProcessState 推进: 请求行 -> 头部(ParseState 逐字节) -> 请求体 -> 分析 -> 完成
+// 每次调用从上次停下的位置继续, 已经扫描过的字节不会再扫描; 请求可以在任意位置被 TCP 分段
+// buf 必须从当前请求的第一个字节开始, 调用之间只能在末尾追加数据 (可能重新分配), 所以只保存偏移量,
+// 完成时才生成指向 buf 的 string_view; 查询参数在 buf 中原处解码, 所以 buf 必须可写
+// 整个过程不分配堆内存; URL 和头部中的普通字节由 http_scanner 批量跳过, 状态机只处理分隔符
+class HttpParser{
+
+    public:
+    HttpParser() : scanner_(default_http_scanner()){ reset(); };
+
+    // 默认使用 CPU 支持的最快实现, 压测时可以指定
+    void set_scanner(const http_scanner* scanner) { scanner_ = scanner; }
+
+    HttpParseResult parse(char* buf, size_t len);
+    // 解析完成后有效, 其中的 string_view 指向传给 parse 的 buf
+    HttpRequest& request() { return req_; }
+    size_t consumed() const { return pos_; }
+    ProcessState state() const { return state_; }
+    // 当前请求从第一个字节算起最多还会用到的长度, 读缓冲区时以此为上限
+    // 头部未完成时为头部上限加一 (足以判定超长), 之后为头部加请求体的长度
+    size_t wanted() const;
+    // HTTP_PARSE_ERROR 对应的状态码: 头部超长 431, 请求体超长 413, 其他 400
+    int error_status() const { return error_status_; }
+    // 开始解析下一个请求, 调用者需要先丢弃已消费的 consumed() 字节
+    void reset();
+
+    private:
+    // 请求行内部的状态
+    enum RequestLineState {
+        RL_METHOD = 0,
+        RL_URL,
+        RL_VERSION,
+        RL_LF
+    };
+
+    // 头部在缓冲区中的位置
+    struct header_span{
+        uint32_t key_begin;
+        uint32_t key_len;
+        uint32_t value_begin;
+        uint32_t value_len;
+    };
+
+    URIState parse_request_line(const char* buf, size_t len);
+    HeaderState parse_headers(const char* buf, size_t len);
+    AnalysisState analyze(char* buf);
+    bool add_header(const char* buf);
+    void bind_headers(const char* buf);
+    HttpParseResult header_too_large();
+
+    ProcessState state_;
+    RequestLineState rl_state_;
+    ParseState h_state_;
+    size_t pos_;            // 下一个要扫描的字节
+    size_t mark_;           // 请求行中当前字段的起点
+    size_t key_begin_;
+    size_t key_end_;
+    size_t value_begin_;
+    size_t value_end_;
+    size_t body_begin_;
+    size_t content_length_;
+    size_t url_begin_;
+    size_t url_len_;
+    const http_scanner* scanner_;
+    header_span spans_[HTTP_MAX_HEADERS];
+    size_t span_count_;
+    int error_status_;
+    HttpRequest req_;
+};
+
+#endif
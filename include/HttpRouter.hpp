@@ -0,0 +1,64 @@
+#ifndef HTTPROUTER_HPP
+#define HTTPROUTER_HPP
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <initializer_list>
+
+#include "../include/HttpData.hpp"
+
+typedef std::function<void(const HttpRequest&, HttpResponse&, void*)> http_handler;
+
+struct http_route{
+    HttpMethod method;
+    const char* pattern;
+    http_handler handler;
+};
+
+// 压缩前缀树 (radix tree) 路由, 启动时构建, 之后只读, 多个工作线程并发查找不需要加锁
+// 路径模式:
+//   /dashboard        静态路径
+//   /user/:id         :name 匹配一个路径段 (到下一个 '/' 为止, 不能为空)
+//   /static/*path     *name 匹配剩余的全部路径 (可以为空), 只能在末尾
+// 同一位置上静态 > 参数 > 通配, 只有静态前缀匹配后下面找不到路由时才回退, 普通路由表查找只扫描一遍 URL
+// 匹配到的参数是指向 url_ 的 string_view, 通过 HttpRequest::param 读取
+class HttpRouter{
+
+    public:
+    HttpRouter(){};
+    // 路由表有错误时直接退出, 不带着残缺的路由表启动
+    HttpRouter(std::initializer_list<http_route> routes);
+
+    HttpRouter(const HttpRouter&) = delete;
+    HttpRouter& operator=(const HttpRouter&) = delete;
+
+    // 只在启动时调用, 模式不合法或与已有路由冲突时打印错误并返回 false
+    bool add(HttpMethod method, std::string_view pattern, http_handler handler);
+
+    // 找到路由时调用处理函数, HEAD 没有注册时使用 GET 的处理函数;
+    // 路径不存在返回 404, 路径存在但方法不支持返回 405 和 Allow 头部
+    void route(HttpRequest& request, HttpResponse& response, void* ptr) const;
+
+    private:
+    struct node{
+        std::string path;                       // 静态前缀, 参数和通配节点为空
+        std::string indices;                    // 静态子节点的首字节, 与 children 一一对应
+        std::vector<std::unique_ptr<node>> children;
+        std::unique_ptr<node> param_child;
+        std::unique_ptr<node> wildcard_child;
+        std::string name;                       // 参数和通配节点的参数名
+        http_handler handlers[HttpMethod::UNKNOWN];
+        bool has_handler;
+        node() : has_handler(false){};
+    };
+
+    static node* insert_static(node* n, std::string_view s);
+    static const node* lookup(const node* n, std::string_view path, HttpRequest& request);
+
+    node root_;
+};
+
+#endif
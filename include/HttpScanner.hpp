@@ -0,0 +1,29 @@
+#ifndef HTTPSCANNER_HPP
+#define HTTPSCANNER_HPP
+
+#include <stddef.h>
+
+// 请求解析器的快速路径: 在 [p, end) 中查找第一个需要状态机处理的字节, 找不到时返回 end
+// url:   空格, CR/LF 和其他控制字符 (请求行中的 URL 和版本)
+// key:   ':', 空格, CR/LF 和其他控制字符 (头部名)
+// value: CR/LF 和除 '\t' 以外的控制字符 (头部值)
+// 返回位置上的字节由状态机判断是分隔符还是非法字节
+struct http_scanner{
+    const char* name;
+    const char* (*url)(const char* p, const char* end);
+    const char* (*key)(const char* p, const char* end);
+    const char* (*value)(const char* p, const char* end);
+};
+
+enum scanner_impl {
+    SCANNER_SCALAR = 0,
+    SCANNER_SSE42,      // PCMPESTRI 范围匹配, 每次 16 字节
+    SCANNER_AVX2        // 比较 + movemask, 每次 32 字节
+};
+
+// 指定的实现, 不是 x86 或 CPU 不支持时返回 nullptr
+const http_scanner* get_http_scanner(scanner_impl impl);
+// 启动时按 CPU 特性选出的最快实现
+const http_scanner* default_http_scanner();
+
+#endif
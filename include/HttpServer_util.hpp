@@ -16,23 +16,28 @@
 #include <unordered_map>
 #include <functional>
 
+#include "Connection.hpp"
 #include "HttpData.hpp"
+#include "HttpRouter.hpp"
 #include "file_utils.hpp"
 #include "server.hpp"
 #include "myjson.hpp"
 #include "WebSocket_util.hpp"
 
-std::string read_http_request(int fd);
-bool send_http_response(int fd, const std::string &response);
-void http_response(void* ptr, EpollWrapper &ew);
+// 响应头部和响应体的各段追加到 out, 响应体不复制; head_only 时只追加头部 (HEAD 请求)
+void append_http_response(std::vector<out_chunk>& out, const HttpResponse& response, bool head_only = false);
+bool send_http_response(connection* conn, const HttpResponse& response);
+bool send_http_response(connection* conn, std::vector<out_chunk>&& responses);
+// 读取并处理连接上的请求, 返回 true 表示响应发送完后关闭写端
+bool http_response(connection* conn);
 
 void handle_root(const HttpRequest&, HttpResponse&, void*);
 void handle_login(const HttpRequest&, HttpResponse&, void*);
 void handle_dashboard(const HttpRequest&, HttpResponse&, void*);
 void handle_upgrade(const HttpRequest&, HttpResponse&, void*);
 
-std::string get_cookie_value(const std::string& cookie_header, const std::string& key);
+std::string_view get_cookie_value(std::string_view cookie_header, std::string_view key);
 
-extern std::unordered_map<std::string, std::function<void(const HttpRequest&, HttpResponse&, void*)>> http_router;
+extern const HttpRouter http_router;
 
 #endif
\ No newline at end of file
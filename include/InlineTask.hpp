@@ -0,0 +1,89 @@
+#ifndef INLINETASK_HPP
+#define INLINETASK_HPP
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// 只能移动的 void() 可调用对象, 捕获的数据直接存放在对象内部的缓冲区中, 构造和移动都不分配内存
+// 代替 std::function: 后者的捕获超过两个指针就要在堆上分配, 而且要求可复制
+// 捕获超过 CAPACITY 字节时编译失败, 这时应该只捕获一个指针或句柄
+class InlineTask{
+
+    public:
+    static const size_t CAPACITY = 64;
+
+    InlineTask() noexcept : ops_(nullptr){}
+
+    template <typename F, typename D = typename std::decay<F>::type,
+              typename = typename std::enable_if<!std::is_same<D, InlineTask>::value>::type>
+    InlineTask(F&& f) : ops_(nullptr){
+        static_assert(sizeof(D) <= CAPACITY, "InlineTask: captures too large, capture a pointer instead");
+        static_assert(alignof(D) <= alignof(std::max_align_t), "InlineTask: over-aligned callable");
+        static_assert(std::is_nothrow_move_constructible<D>::value, "InlineTask: callable must be nothrow movable");
+        new (buf_) D(std::forward<F>(f));
+        ops_ = &table<D>;
+    }
+
+    InlineTask(InlineTask&& other) noexcept : ops_(other.ops_){
+        if(ops_){
+            ops_->move(buf_, other.buf_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    InlineTask& operator=(InlineTask&& other) noexcept{
+        if(this != &other){
+            reset();
+            if(other.ops_){
+                other.ops_->move(buf_, other.buf_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    InlineTask(const InlineTask&) = delete;
+    InlineTask& operator=(const InlineTask&) = delete;
+
+    ~InlineTask(){ reset(); }
+
+    void operator()(){ ops_->invoke(buf_); }
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    // 析构保存的可调用对象, 释放它持有的资源
+    void reset(){
+        if(ops_){
+            ops_->destroy(buf_);
+            ops_ = nullptr;
+        }
+    }
+
+    private:
+    struct ops_table{
+        void (*invoke)(void*);
+        // 移动构造到 dst 并析构 src
+        void (*move)(void* dst, void* src);
+        void (*destroy)(void*);
+    };
+
+    template <typename D>
+    static void invoke_fn(void* p){ (*static_cast<D*>(p))(); }
+    template <typename D>
+    static void move_fn(void* dst, void* src){
+        new (dst) D(std::move(*static_cast<D*>(src)));
+        static_cast<D*>(src)->~D();
+    }
+    template <typename D>
+    static void destroy_fn(void* p){ static_cast<D*>(p)->~D(); }
+
+    template <typename D>
+    static constexpr ops_table table = {&invoke_fn<D>, &move_fn<D>, &destroy_fn<D>};
+
+    alignas(std::max_align_t) unsigned char buf_[CAPACITY];
+    const ops_table* ops_;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef IOURINGWRAPPER_HPP
+#define IOURINGWRAPPER_HPP
+
+#include "../include/tinystl/vector.h"
+#include "../include/Poller.hpp"
+
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#endif
+
+#ifdef HAVE_IO_URING
+
+// 基于 io_uring 的 Poller 实现, 直接使用系统调用, 不依赖 liburing
+// add/mod/del 只写入提交队列, 由 reactor 线程在 wait() 中一次 io_uring_enter 批量提交
+// 其他线程(线程池)的重新注册同样留给 reactor 的下一次 wait(), 只有 reactor 正阻塞在 io_uring_enter 中时
+// 才由调用线程自己提交, 否则注册会被推迟到下一个完成事件
+// 只有就绪通知和 accept 经过 io_uring, recv/send 仍由工作线程直接调用
+// 内核支持 IORING_OP_ACCEPT 时提供完成式 accept, 优先 multishot, 不支持时每次完成后重新提交
+class IoUringWrapper : public Poller{
+
+    public:
+    explicit IoUringWrapper(unsigned entries = 4096);
+    ~IoUringWrapper();
+
+    IoUringWrapper(const IoUringWrapper&) = delete;
+    IoUringWrapper& operator=(const IoUringWrapper&) = delete;
+
+    // 内核不支持 io_uring 或被禁用时为 false
+    bool ok() const { return ring_fd_ >= 0; }
+
+    bool add_fd(int fd, uint32_t events) override;
+    bool add_fd(uint64_t data, int fd, uint32_t events) override;
+    bool mod_fd(int fd, uint32_t events) override;
+    bool mod_fd(uint64_t data, int fd, uint32_t events) override;
+    bool del_fd(int fd) override;
+    int wait(int timeout = -1) override;
+    mystl::vector<epoll_event>::iterator get_events() override;
+    const char* name() const override { return "io_uring"; }
+
+    bool accept_multishot(int listen_fd, uint64_t data) override;
+    int take_accepted(uint64_t data, int* fds, int max) override;
+
+    private:
+    struct poll_entry{
+        uint64_t data;
+        uint32_t events;
+        uint32_t gen;
+        bool in_use;
+        bool armed;
+    };
+
+    struct accept_entry{
+        int fd;
+        uint64_t data;
+        std::vector<int> ready;
+    };
+
+    bool probe_accept();
+    io_uring_sqe* get_sqe();
+    void publish();
+    unsigned pending();
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t argsz);
+    void submit_if_foreign();
+    bool arm(uint64_t data, int fd, uint32_t events, bool is_mod);
+    void queue_poll_add(int fd, poll_entry& e);
+    void queue_poll_remove(const poll_entry& e, int fd);
+    void queue_accept(size_t idx);
+    void reap(int& n);
+    void handle_cqe(const io_uring_cqe& cqe, int& n);
+
+    int ring_fd_;
+    // SQ 和 CQ 共用一次 mmap (IORING_FEAT_SINGLE_MMAP)
+    void* ring_ptr_;
+    size_t ring_len_;
+    // 提交队列
+    unsigned* sq_khead_;
+    unsigned* sq_ktail_;
+    unsigned* sq_kmask_;
+    unsigned* sq_array_;
+    io_uring_sqe* sqes_;
+    size_t sqes_len_;
+    unsigned sq_tail_;
+    unsigned sq_entries_;
+    // 完成队列
+    unsigned* cq_khead_;
+    unsigned* cq_ktail_;
+    unsigned* cq_kmask_;
+    io_uring_cqe* cqes_;
+    // 内核是否支持 IORING_OP_ACCEPT, 以及 IORING_ACCEPT_MULTISHOT (5.19)
+    bool accept_ok_;
+    bool multishot_ok_;
+
+    std::mutex mtx_;
+    // 调用 wait() 的 reactor 线程, 它的提交可以延迟到下一次 wait() 一起完成
+    std::atomic<std::thread::id> owner_;
+    // reactor 即将或正在 io_uring_enter 中等待, 由 mtx_ 保护
+    bool waiting_;
+    std::vector<poll_entry> polls_;
+    std::vector<accept_entry> accepts_;
+    mystl::vector<epoll_event> events_;
+};
+
+#endif
+
+#endif
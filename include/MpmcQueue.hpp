@@ -0,0 +1,96 @@
+#ifndef MPMCQUEUE_HPP
+#define MPMCQUEUE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+// 有界的多生产者多消费者环形队列 (Dmitry Vyukov 的算法)
+// 每个槽带一个序号, 生产者和消费者各自用一次 CAS 抢到位置, 之后只写自己的槽, 不加锁
+// 容量固定为 2 的幂, 满时 push 返回 false, 不会无限增长
+template <typename T>
+class MpmcQueue{
+
+    public:
+    explicit MpmcQueue(size_t capacity = 65536)
+        : mask_(round_up(capacity) - 1), cells_(new cell[mask_ + 1]), enqueue_pos_(0), dequeue_pos_(0){
+        for(size_t i = 0; i <= mask_; ++i)
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    bool push(const T& item){
+        cell* c;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while(true){
+            c = &cells_[pos & mask_];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0){
+                if(enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0)
+                return false;   // 满
+            else
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+        c->data = item;
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item){
+        cell* c;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        while(true){
+            c = &cells_[pos & mask_];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(diff == 0){
+                if(dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0)
+                return false;   // 空, 或者生产者已占位还没写完
+            else
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+        item = c->data;
+        c->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 近似值, 并发修改时可能短暂偏差
+    size_t size() const{
+        size_t e = enqueue_pos_.load(std::memory_order_relaxed);
+        size_t d = dequeue_pos_.load(std::memory_order_relaxed);
+        return e > d ? e - d : 0;
+    }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return mask_ + 1; }
+
+    private:
+    struct cell{
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    static size_t round_up(size_t n){
+        size_t c = 2;
+        while(c < n)
+            c <<= 1;
+        return c;
+    }
+
+    size_t mask_;
+    std::unique_ptr<cell[]> cells_;
+    // 生产者和消费者的位置放在不同的缓存行
+    alignas(64) std::atomic<size_t> enqueue_pos_;
+    alignas(64) std::atomic<size_t> dequeue_pos_;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef POLLER_HPP
+#define POLLER_HPP
+
+#include "../include/tinystl/vector.h"
+
+#include <sys/epoll.h>
+#include <stdint.h>
+#include <memory>
+
+enum io_backend{
+    IO_EPOLL,
+    IO_URING
+};
+
+// reactor 使用的 I/O 多路复用接口, 语义与 epoll 一致
+// EpollWrapper 和 IoUringWrapper 两种实现, 由 make_poller 在运行时选择
+class Poller{
+
+    public:
+    virtual ~Poller() = default;
+
+    virtual bool add_fd(int fd, uint32_t events) = 0;
+    // data 作为事件的 data.u64 返回, 连接使用 conn_handle
+    virtual bool add_fd(uint64_t data, int fd, uint32_t events) = 0;
+    virtual bool mod_fd(int fd, uint32_t events) = 0;
+    virtual bool mod_fd(uint64_t data, int fd, uint32_t events) = 0;
+    virtual bool del_fd(int fd) = 0;
+    virtual int wait(int timeout = -1) = 0;
+    virtual mystl::vector<epoll_event>::iterator get_events() = 0;
+    virtual const char* name() const = 0;
+
+    // 完成式 accept: 后端自己接收连接, 监听套接字的事件只作为通知,
+    // 新连接通过 take_accepted 取出. 不支持的后端返回 false, 由调用者 accept4
+    virtual bool accept_multishot(int listen_fd, uint64_t data){ return false; }
+    virtual int take_accepted(uint64_t data, int* fds, int max){ return 0; }
+};
+
+// 创建指定后端, io_uring 不可用时回退到 epoll
+std::unique_ptr<Poller> make_poller(io_backend backend);
+
+#endif
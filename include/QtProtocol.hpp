@@ -0,0 +1,55 @@
+#ifndef QTPROTOCOL_HPP
+#define QTPROTOCOL_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+// qt 端口上的二进制消息协议, 给桌面客户端使用, 不需要 HTTP 升级和 WebSocket 掩码
+// 每帧为 12 字节定长头部 + payload, 整数均为网络字节序:
+// | length (u32) | type (u16) | flags (u16) | user_id (u32) | payload (length 字节) |
+enum qt_msg_type : uint16_t{
+    QT_LOGIN = 1,   // c->s: payload 为用户名; s->c: 登录成功, user_id 为分配的 id
+    QT_CHAT = 2,    // c->s: payload 为消息; s->c: 转发的消息, user_id 为发送者
+    QT_LOGOUT = 3,
+    QT_PING = 4,    // 服务器原样回复 QT_PONG
+    QT_PONG = 5,
+    QT_ERROR = 6    // s->c: payload 为错误描述
+};
+
+const size_t QT_HEADER_SIZE = 12;
+const uint32_t QT_MAX_PAYLOAD = 1 << 20;
+
+struct qt_frame{
+    uint16_t type;
+    uint16_t flags;
+    uint32_t user_id;
+    std::string payload;
+};
+
+std::string encode_qt_frame(uint16_t type, uint32_t user_id, const char* payload, size_t len, uint16_t flags = 0);
+std::string encode_qt_frame(uint16_t type, uint32_t user_id, const std::string& payload, uint16_t flags = 0);
+
+// 流式解码器, 可以喂入任意切分的字节流, 不完整的帧留在内部缓冲区等待后续数据
+class QtFrameDecoder{
+
+    public:
+    QtFrameDecoder() : pos_(0), error_(false){};
+
+    void feed(const char* data, size_t len);
+    // 取出下一个完整的帧, 数据不足或出错时返回 false
+    bool next(qt_frame& frame);
+    // 帧长度超过 QT_MAX_PAYLOAD, 之后的数据无法再对齐帧边界
+    bool error() const { return error_; }
+    size_t buffered() const { return buf_.size() - pos_; }
+    // 下一个帧的完整长度, 头部还不完整或长度超限时为 QT_HEADER_SIZE; 读 socket 时以此限制缓冲区
+    size_t wanted() const;
+    void reset();
+
+    private:
+    std::string buf_;
+    size_t pos_;
+    bool error_;
+};
+
+#endif
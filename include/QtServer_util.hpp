@@ -0,0 +1,13 @@
+#ifndef QTSERVER_UTIL_HPP
+#define QTSERVER_UTIL_HPP
+
+#include <string>
+#include <cstdint>
+
+#include "QtProtocol.hpp"
+#include "server.hpp"
+
+// 读取并处理 qt 连接上的所有完整帧, 返回 true 表示发送完后关闭写端
+bool qt_response(connection* conn);
+
+#endif
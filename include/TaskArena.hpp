@@ -0,0 +1,84 @@
+#ifndef TASKARENA_HPP
+#define TASKARENA_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <memory>
+
+// 定长节点的对象池, 空闲节点组成无锁的 Treiber 栈
+// 节点按块分配, 分配后直到对象池析构都不释放, 所以弹出时读到被其他线程重用的节点也是安全的;
+// 栈顶保存 (标记, 下标), 每次修改标记加一, 避免 ABA
+// T 需要有成员 uint32_t arena_index 和 std::atomic<uint32_t> next_free,
+// 池用尽时 alloc 返回 nullptr, 调用方自己从堆上分配并把 arena_index 设为 HEAP_INDEX
+template <typename T>
+class TaskArena{
+
+    public:
+    static const uint32_t CHUNK_BITS = 10;
+    static const uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+    static const uint32_t HEAP_INDEX = UINT32_MAX;
+
+    explicit TaskArena(size_t max_nodes = 1u << 20)
+        : max_chunks_((max_nodes + CHUNK_SIZE - 1) / CHUNK_SIZE), chunks_(new std::unique_ptr<T[]>[max_chunks_]), nchunks_(0), head_(0){}
+
+    TaskArena(const TaskArena&) = delete;
+    TaskArena& operator=(const TaskArena&) = delete;
+
+    T* alloc(){
+        uint64_t head = head_.load(std::memory_order_acquire);
+        while(head_index(head) != 0){
+            T* node = at(head_index(head) - 1);
+            uint32_t next = node->next_free.load(std::memory_order_relaxed);
+            uint64_t desired = ((head >> 32) + 1) << 32 | next;
+            if(head_.compare_exchange_weak(head, desired, std::memory_order_acquire, std::memory_order_acquire))
+                return node;
+        }
+        return grow();
+    }
+
+    void free(T* node){
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t desired;
+        do{
+            node->next_free.store(head_index(head), std::memory_order_relaxed);
+            desired = ((head >> 32) + 1) << 32 | (node->arena_index + 1);
+        }while(!head_.compare_exchange_weak(head, desired, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // 已经分配的节点数
+    size_t capacity() const { return (size_t)nchunks_.load(std::memory_order_relaxed) * CHUNK_SIZE; }
+
+    private:
+    // 低 32 位是节点下标加一, 0 表示空
+    static uint32_t head_index(uint64_t head){ return (uint32_t)head; }
+
+    T* at(uint32_t index) const{
+        return &chunks_[index >> CHUNK_BITS][index & (CHUNK_SIZE - 1)];
+    }
+
+    // 空闲栈为空时分配新的一块, 返回其中一个节点, 其余放入空闲栈
+    T* grow(){
+        std::lock_guard<std::mutex> lg(grow_mtx_);
+        uint32_t n = nchunks_.load(std::memory_order_relaxed);
+        if(n == max_chunks_)
+            return nullptr;
+        chunks_[n].reset(new T[CHUNK_SIZE]);
+        T* chunk = chunks_[n].get();
+        for(uint32_t i = 0; i < CHUNK_SIZE; ++i)
+            chunk[i].arena_index = n * CHUNK_SIZE + i;
+        nchunks_.store(n + 1, std::memory_order_release);
+        for(uint32_t i = 1; i < CHUNK_SIZE; ++i)
+            free(&chunk[i]);
+        return &chunk[0];
+    }
+
+    uint32_t max_chunks_;
+    std::unique_ptr<std::unique_ptr<T[]>[]> chunks_;
+    std::atomic<uint32_t> nchunks_;
+    std::mutex grow_mtx_;
+    alignas(64) std::atomic<uint64_t> head_;
+};
+
+#endif
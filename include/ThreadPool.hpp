@@ -2,7 +2,10 @@
 #define THREADPOOL_HPP
 
 #include "./tinystl/vector.h"
-#include "./tinystl/queue.h"
+#include "./WorkStealingDeque.hpp"
+#include "./MpmcQueue.hpp"
+#include "./InlineTask.hpp"
+#include "./TaskArena.hpp"
 
 #include <thread>
 #include <atomic>
@@ -10,8 +13,11 @@
 #include <condition_variable>
 #include <functional>
 #include <future>
+#include <memory>
+#include <stdexcept>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 class ThreadsGuard{
     public:
@@ -37,42 +43,140 @@ class ThreadsGuard{
     mystl::vector<std::thread>& threads_;
 };
 
+// 任务的优先级: 高优先级用于延迟敏感的短任务 (WebSocket / qt 聊天), 普通优先级用于 HTTP 请求等
+enum task_priority{
+    PRIORITY_HIGH = 0,
+    PRIORITY_NORMAL,
+    PRIORITY_COUNT
+};
+
+// 工作窃取线程池
+// 每个工作线程有一个无锁的 Chase-Lev 双端队列, 工作线程内提交的任务放入自己的队列;
+// 其他线程 (reactor) 提交的任务放入有界的全局注入队列, 工作线程每次从中取走一批放进自己的队列,
+// 自己的队列为空时从随机选择的其他工作线程窃取; 都没有任务时短暂自旋后睡眠
+// 任务节点来自无锁的对象池, 可调用对象内联保存在节点中, post 提交不分配内存
+// 注入队列满时 try_post / try_add_task 立即失败, 由调用方暂停读取或丢弃负载; post / add_task 等待队列腾出空间
+// 高优先级任务放在单独的有界队列中, 工作线程优先执行; 连续执行 HIGH_BURST 个高优先级任务后
+// 必须先取一个普通任务 (有的话), 普通任务不会被饿死
 class ThreadPool{
     public:
-    using task_type = std::function<void()>;
+    using task_type = InlineTask;
 
     public:
     //Construct
-    explicit ThreadPool(int n = 0);
+    // 连续执行高优先级任务的上限
+    static const int HIGH_BURST = 8;
+
+    // n <= 0 时使用检测到的 CPU 数
+    // queue_capacity: 每个优先级注入队列的容量, 向上取整为 2 的幂
+    // cpus 非空时第 i 个工作线程绑定到 cpus[i % cpus.size()], 线程自己的队列在绑定之后分配, 位于本地 NUMA 节点
+    explicit ThreadPool(int n = 0, size_t queue_capacity = 65536, const std::vector<int>& cpus = std::vector<int>());
     ~ThreadPool();
 
+    // 工作线程在当前任务结束后退出, 未执行的任务被丢弃
     void stop();
+    int size() const { return nthreads; }
+
+    // 注入队列中等待的任务数 (近似值) 和容量, 以及 try_post / try_add_task 因队列满而失败的次数
+    size_t queue_depth(task_priority priority = PRIORITY_NORMAL) const { return injected_[priority].size(); }
+    size_t queue_capacity() const { return injected_[PRIORITY_NORMAL].capacity(); }
+    uint64_t rejected() const { return rejected_.load(std::memory_order_relaxed); }
+
+    // 不需要结果的任务: 可调用对象 (包括捕获) 不超过 InlineTask::CAPACITY 字节, 不分配内存
+    // 任务抛出的异常不会被捕获
+    // 队列满时等待; 在工作线程中调用时直接执行, 避免所有工作线程互相等待
+    template <typename func>
+    void post(func&& function, task_priority priority = PRIORITY_NORMAL){
+        if(stop_.load(std::memory_order_acquire))
+            throw std::runtime_error("thread pool has stopped");
+        task_node* t = alloc_node();
+        t->fn = task_type(std::forward<func>(function));
+        submit(t, priority);
+    }
 
+    // 队列满或线程池已停止时返回 false, 任务不会执行 (function 已被移动走并销毁)
+    template <typename func>
+    bool try_post(func&& function, task_priority priority = PRIORITY_NORMAL){
+        if(stop_.load(std::memory_order_acquire))
+            return false;
+        task_node* t = alloc_node();
+        t->fn = task_type(std::forward<func>(function));
+        if(try_submit(t, priority))
+            return true;
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        free_node(t);
+        return false;
+    }
+
+    // 需要结果或异常时使用, 每个任务额外分配 packaged_task 和 future 的共享状态
     template <typename func, typename... Args>
     std::future<typename std::result_of<func(Args...)>::type> add_task(func&& function, Args&&... args){
         using return_type = typename std::result_of<func(Args...)>::type;
         using task = std::packaged_task<return_type()>;
-    
+
         auto task_ = std::make_shared<task>(std::bind(std::forward<func>(function), std::forward<Args>(args)...));
         auto ret = task_->get_future();
-        {
-            std::lock_guard<std::mutex> lg(mtx_);
-            if(stop_.load(std::memory_order_acquire))
-                throw std::runtime_error("thread pool has stopped");
-            tasks_.emplace([task_]{ (*task_)(); });
-        }
-        cond_.notify_one();
+        post([task_]{ (*task_)(); });
         return ret;
     }
 
+    // 队列满或线程池已停止时返回无效的 future (valid() 为 false)
+    template <typename func, typename... Args>
+    std::future<typename std::result_of<func(Args...)>::type> try_add_task(func&& function, Args&&... args){
+        using return_type = typename std::result_of<func(Args...)>::type;
+        using task = std::packaged_task<return_type()>;
+
+        auto task_ = std::make_shared<task>(std::bind(std::forward<func>(function), std::forward<Args>(args)...));
+        auto ret = task_->get_future();
+        if(!try_post([task_]{ (*task_)(); }))
+            return std::future<return_type>();
+        return ret;
+    }
+
+    private:
+    struct task_node{
+        task_type fn;
+        uint32_t arena_index;
+        std::atomic<uint32_t> next_free;
+    };
+
+    // 每个工作线程的状态独占缓存行, 避免相邻线程的队列下标互相干扰
+    struct alignas(64) worker{
+        WorkStealingDeque<task_node> deque;
+        uint32_t rng;
+        // 连续执行的高优先级任务数
+        int high_streak;
+    };
+
+    task_node* alloc_node();
+    void free_node(task_node* t);
+    bool try_submit(task_node* t, task_priority priority);
+    void submit(task_node* t, task_priority priority);
+    void worker_loop(int id);
+    task_node* find_task(int id);
+    task_node* find_normal_task(int id);
+    task_node* take_injected(int id);
+    task_node* steal_task(int id);
+    bool has_work();
+    void wake_one();
+
     private:
     int nthreads;
     std::atomic<bool> stop_;
+    // 由各工作线程自己分配
+    std::unique_ptr<std::unique_ptr<worker>[]> workers_;
+    TaskArena<task_node> arena_;
+    // 全局注入队列, 下标为 task_priority; 高优先级的任务不进入工作线程自己的队列
+    MpmcQueue<task_node*> injected_[PRIORITY_COUNT];
+    std::atomic<uint64_t> rejected_;
+    // 睡眠和唤醒
     std::mutex mtx_;
     std::condition_variable cond_;
-    mystl::queue<task_type> tasks_;
+    std::atomic<int> sleeping_;
+    // 已经分配好自己队列的工作线程数, 由 mtx_ 保护
+    int ready_;
     mystl::vector<std::thread> threads_;
     ThreadsGuard tg_;
 };
 
-#endif
\ No newline at end of file
+#endif
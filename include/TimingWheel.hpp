@@ -0,0 +1,86 @@
+#ifndef TIMINGWHEEL_HPP
+#define TIMINGWHEEL_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// 侵入式定时器节点, 嵌入在需要超时的对象中, 插入/删除都不分配内存
+struct timer_node{
+    timer_node* prev;
+    timer_node* next;
+    uint64_t expire;    // 到期的 tick
+    void* data;
+    timer_node() : prev(nullptr), next(nullptr), expire(0), data(nullptr){};
+    bool linked() const { return next != nullptr; }
+};
+
+// 分层时间轮, 4 层 x 64 槽, 插入/删除/重新调度都是 O(1)
+// tick 为 100ms 时第 0 层覆盖 6.4s, 第 3 层覆盖约 19 天
+// 只由所属 reactor 线程操作, 不加锁
+class TimingWheel{
+
+    public:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const int SLOTS = 1 << SLOT_BITS;
+
+    explicit TimingWheel(uint64_t tick_ms = 100);
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    // 在 now_ms + delay_ms 到期, 已经在时间轮中的节点会被移动
+    void schedule(timer_node* t, uint64_t now_ms, uint64_t delay_ms);
+    // 只把到期时间提前: 节点已经会在 now_ms + delay_ms 之前到期时不移动
+    void schedule_no_later(timer_node* t, uint64_t now_ms, uint64_t delay_ms);
+    void cancel(timer_node* t);
+    // 距下一个需要处理的 tick 的毫秒数, 作为 epoll_wait 的超时, 没有定时器时返回 -1
+    int next_timeout(uint64_t now_ms) const;
+    size_t size() const { return size_; }
+
+    // 推进到 now_ms, 对每个到期节点调用 on_expire(timer_node*), 回调中可以重新 schedule
+    template <typename F>
+    void advance(uint64_t now_ms, F&& on_expire){
+        uint64_t target = now_ms / tick_ms_;
+        if(size_ == 0){
+            if(target > current_)
+                current_ = target;
+            return;
+        }
+        while(current_ < target){
+            ++current_;
+            if((current_ & (SLOTS - 1)) == 0)
+                cascade();
+
+            // 先把整个槽摘下来, 回调中重新调度的节点不会被重复处理
+            timer_node expired;
+            splice(&slots_[0][current_ & (SLOTS - 1)], &expired);
+            while(expired.next != &expired){
+                timer_node* t = expired.next;
+                unlink(t);
+                on_expire(t);
+            }
+        }
+    }
+
+    // 单调时钟, 毫秒
+    static uint64_t now_ms(){
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    private:
+    void link(timer_node* t);
+    void unlink(timer_node* t);
+    void cascade();
+    static void splice(timer_node* from, timer_node* to);
+
+    timer_node slots_[LEVELS][SLOTS];   // 每个槽是带哨兵的双向循环链表
+    uint64_t tick_ms_;
+    uint64_t current_;
+    size_t size_;
+};
+
+#endif
@@ -7,9 +7,24 @@
 
 #include "server.hpp"
 
-std::string decode_websocket_frame(const std::vector<uint8_t>& buffer);
+// 单个帧的负载上限, 超过时视为协议错误; 分片拼接后的消息也不能超过它
+const uint64_t MAX_WS_PAYLOAD = 1024 * 1024;
+// 客户端帧头最长 14 字节: 2 字节 + 8 字节扩展长度 + 4 字节掩码
+const size_t WS_MAX_HEADER = 14;
+
+enum ws_frame_result {
+    WS_FRAME_OK,
+    WS_FRAME_AGAIN,     // 帧不完整, 等待更多数据
+    WS_FRAME_ERROR      // 没有掩码, 负载过大, 或者控制帧分片/超过 125 字节
+};
+
+// 从 data 开头解码一个客户端帧, 成功时 consumed 为整个帧的长度
+// 不完整时 consumed 为这个帧至少需要的长度 (帧头还不完整时为 WS_MAX_HEADER)
+ws_frame_result decode_websocket_frame(const char* data, size_t len, uint8_t& opcode, bool& fin, std::string& payload, size_t& consumed);
+std::vector<uint8_t> build_websocket_frame(uint8_t opcode, const std::string& payload);
 std::vector<uint8_t> build_websocket_text_frame(const std::string& message);
 
-void websocket_response(void* ptr, EpollWrapper &ew);
+// 处理 conn->in_buf 中和新读到的所有完整帧, 需要关闭连接时返回 true
+bool websocket_response(connection* conn);
 
 #endif
\ No newline at end of file
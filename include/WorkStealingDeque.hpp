@@ -0,0 +1,94 @@
+#ifndef WORKSTEALINGDEQUE_HPP
+#define WORKSTEALINGDEQUE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+// 有界的 Chase-Lev 工作窃取双端队列, 存放指针
+// 只有所属的工作线程在底部 push / pop (LIFO, 刚放入的任务数据还在缓存中),
+// 其他线程从顶部 steal (FIFO), 全程无锁; 内存序按 Lê 等人的 C11 版本
+// 容量固定为 2 的幂, 满时 push 返回 false, 由调用方放到全局注入队列
+template <typename T>
+class WorkStealingDeque{
+
+    public:
+    explicit WorkStealingDeque(size_t capacity = 1024)
+        : mask_(round_up(capacity) - 1), slots_(new std::atomic<T*>[mask_ + 1]), top_(0), bottom_(0){
+        for(size_t i = 0; i <= mask_; ++i)
+            slots_[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // 只能由所属线程调用
+    bool push(T* item){
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        if(b - t > (int64_t)mask_)
+            return false;
+        slots_[b & mask_].store(item, std::memory_order_relaxed);
+        bottom_.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 只能由所属线程调用, 空时返回 nullptr
+    T* pop(){
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if(t > b){
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T* item = slots_[b & mask_].load(std::memory_order_relaxed);
+        if(t == b){
+            // 最后一个元素, 与窃取者竞争
+            if(!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                item = nullptr;
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // 任意线程调用, 空或者与其他线程竞争失败时返回 nullptr
+    T* steal(){
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if(t >= b)
+            return nullptr;
+        T* item = slots_[t & mask_].load(std::memory_order_relaxed);
+        if(!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr;
+        return item;
+    }
+
+    // 近似值, 只用于判断是否有任务可偷
+    size_t size() const{
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? (size_t)(b - t) : 0;
+    }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return mask_ + 1; }
+
+    private:
+    static size_t round_up(size_t n){
+        size_t c = 2;
+        while(c < n)
+            c <<= 1;
+        return c;
+    }
+
+    size_t mask_;
+    std::unique_ptr<std::atomic<T*>[]> slots_;
+    // top 被窃取者频繁修改, 与 bottom 放在不同的缓存行
+    alignas(64) std::atomic<int64_t> top_;
+    alignas(64) std::atomic<int64_t> bottom_;
+};
+
+#endif
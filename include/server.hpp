@@ -16,52 +16,120 @@
 #include <iostream>
 #include <unordered_map>
 #include <set>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 #include "../include/tinystl/vector.h"
-#include "../include/EpollWrapper.hpp"
+#include "../include/Poller.hpp"
+#include "../include/TimingWheel.hpp"
+#include "../include/Connection.hpp"
 #include "../include/ThreadPool.hpp"
 #include "../include/HttpData.hpp"
 #include "../include/file_utils.hpp"
 #include "../include/HttpServer_util.hpp"
+#include "../include/AssetCache.hpp"
+#include "../include/Affinity.hpp"
 #include "WebSocket_util.hpp"
+#include "QtServer_util.hpp"
+
+struct server_options{
+    // 反应堆(reactor)线程数, 每个线程拥有自己的 epoll 和 SO_REUSEPORT 监听套接字
+    int reactors = 1;
+    // 每次唤醒最多 accept 的连接数, 超出部分留到处理完本轮事件之后, 保证公平
+    int accept_batch = 64;
+    // 所有 reactor 共用一个监听套接字, 以 EPOLLEXCLUSIVE 注册, 代替 SO_REUSEPORT
+    bool shared_listener = false;
+    // I/O 后端, io_uring 不可用时自动回退到 epoll
+    io_backend backend = IO_EPOLL;
+    // 连接超时(毫秒), 0 表示不限制
+    // header: 建立连接后, 以及缓冲区中留有不完整的请求时 (从它的第一个字节算起, 之后到达的字节不会推迟); idle: keep-alive 空闲; ws_idle: WebSocket 和 qt 长连接空闲; write: 发送阻塞
+    int header_timeout_ms = 10000;
+    int idle_timeout_ms = 60000;
+    int ws_idle_timeout_ms = 600000;
+    int write_timeout_ms = 30000;
+    // 连接只注册一次 EPOLLET (不带 EPOLLONESHOT), 任务结束时不再调用 epoll_ctl 重新注册
+    // 同一连接的互斥由 connection 中的调度状态保证
+    bool persistent_registration = false;
+    // 线程池注入队列的容量, 队列满时 reactor 暂停分发任务和 accept, 直到工作线程赶上
+    size_t task_queue_capacity = 65536;
+    // 运行中报告注入队列深度和被拒绝的提交的间隔(毫秒), 只在有积压时打印, 0 表示只在退出时打印
+    int stats_interval_ms = 5000;
+    // 线程池的工作线程数, 0 表示检测到的 CPU 数
+    int workers = 0;
+    // 把 reactor 和工作线程绑定到固定的 CPU, 各自的缓冲区在绑定的 CPU 所在的 NUMA 节点上分配
+    // reactor 依次占用按节点交错排列的 CPU, 工作线程从其后的 CPU 开始, CPU 不够时回绕共用
+    bool pin_threads = false;
+};
 
 class server{
     public:
-    server(const char* ip, uint16_t http_port, uint16_t qt_port);
+    server(const char* ip, uint16_t http_port, uint16_t qt_port, const server_options& opts = server_options());
     int start();
     void end();
 
     private:
+    struct reactor{
+        int id;
+        std::unique_ptr<Poller> poller;
+        int http_listen_sock_;
+        bool accept_pending;
+        // qt 监听套接字只在 reactor 0 上
+        bool qt_accept_pending;
+        // 由后端完成 accept (io_uring multishot accept)
+        bool multishot_accept;
+        TimingWheel wheel;
+        // 绑定的 CPU, -1 表示不绑定
+        int cpu;
+        // 线程池队列满时没能提交任务的连接, 下标为任务优先级, 按到达顺序在之后的每一轮重试
+        std::vector<conn_handle> deferred[PRIORITY_COUNT];
+        // 线程池计数器的定期报告, 只由 reactor 0 负责
+        uint64_t next_report;
+        uint64_t reported_rejected;
+        std::thread thread_;
+        reactor(int i, io_backend backend) : id(i), poller(make_poller(backend)), http_listen_sock_(-1), accept_pending(false), qt_accept_pending(false), multishot_accept(false), cpu(-1), next_report(0), reported_rejected(0){};
+    };
+
+    int open_http_listener();
+    bool accept_connections(reactor& r, int listen_sock, connProto type, bool multishot);
+    void close_connection(reactor& r, connection* conn);
+    void on_timeout(reactor& r, connection* conn);
+    void dispatch(reactor& r, conn_handle h, task_priority priority);
+    bool retry_deferred(reactor& r);
+    void run_reactor(reactor& r);
+    void report_placement();
+    void report_backpressure(reactor& r);
+
     struct sockaddr_in http_address;
-    int http_listen_sock_;
     struct sockaddr_in qt_address;
     int qt_listen_sock_;
-    bool stop;
-    EpollWrapper ew;
+    int event_fd_;
+    server_options opts_;
+    std::atomic<bool> stop;
+    std::vector<std::unique_ptr<reactor>> reactors_;
     ThreadPool thread_pool;
 };
 
-enum connProto{
-    HTTP,
-    WEBSOCKET,
-    QT,
-    OTHER
-};
-
-class connection{
-    public:
-    int fd;
-    connProto conn_type;
-    std::string username;
-    connection(int f, connProto t) : fd(f), conn_type(t), username(){};
-};
-
 void set_nonblocking(int fd);
-std::string read_http_request(int fd);
-bool send_http_response(int fd, const std::string &response);
+// 一次 recv 的长度, 也是读请求时超出当前请求所需长度的余量
+const size_t HTTP_READ_CHUNK = 16384;
+ssize_t read_http_request(int fd, std::string& buf, size_t limit = SIZE_MAX);
+bool send_http_response(connection* conn, const HttpResponse& response);
+
+// 所有连接, 由 accept 它的 reactor 打开和关闭, 其他线程通过 conn_handle 取得引用
+extern ConnectionTable connections;
+// 已登录的 WebSocket 用户, 由 conn_mtx 保护
+extern std::mutex conn_mtx;
+extern std::map<std::string, connection*> user_to_connection;
 
-extern std::map<std::string, std::shared_ptr<connection>> user_to_connection;
-extern std::unordered_map<int, std::string> fd_to_user;
-extern std::unordered_map<int, std::shared_ptr<connection>> connections;
+// WebSocket 和 qt 连接共用的用户表操作
+// 登录并分配 user_id, 同名的旧连接被替换; 连接已被关闭时返回 false
+bool register_user(connection* conn, const std::string& name, connProto type);
+void unregister_user(connection* conn);
+// 转发给除 from 以外的所有用户, 按接收方的协议分别编码; from 未登录时返回 false
+bool broadcast_chat(connection* from, const std::string& msg);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include "../include/Affinity.hpp"
+
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fstream>
+#include <string>
+#include <mutex>
+
+struct numa_topology{
+    // 下标为 CPU 编号
+    std::vector<int> node_of;
+    int nodes = 1;
+};
+
+// 解析 "0-3,8-11" 格式的 CPU 列表
+static void parse_cpulist(const std::string& list, std::vector<int>& cpus){
+    size_t pos = 0;
+    while(pos < list.size()){
+        size_t comma = list.find(',', pos);
+        std::string range = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = comma == std::string::npos ? list.size() : comma + 1;
+        if(range.empty() || range[0] < '0' || range[0] > '9')
+            continue;
+        int first = atoi(range.c_str());
+        size_t dash = range.find('-');
+        int last = dash == std::string::npos ? first : atoi(range.c_str() + dash + 1);
+        for(int c = first; c <= last; ++c)
+            cpus.push_back(c);
+    }
+}
+
+static const numa_topology& topology(){
+    static numa_topology topo;
+    static std::once_flag once;
+    std::call_once(once, []{
+        DIR* dir = opendir("/sys/devices/system/node");
+        if(!dir)
+            return;
+        int max_node = -1;
+        while(struct dirent* ent = readdir(dir)){
+            if(strncmp(ent->d_name, "node", 4) != 0 || ent->d_name[4] < '0' || ent->d_name[4] > '9')
+                continue;
+            int node = atoi(ent->d_name + 4);
+            std::ifstream in(std::string("/sys/devices/system/node/") + ent->d_name + "/cpulist");
+            std::string list;
+            if(!std::getline(in, list))
+                continue;
+            std::vector<int> cpus;
+            parse_cpulist(list, cpus);
+            for(int c : cpus){
+                if((int)topo.node_of.size() <= c)
+                    topo.node_of.resize(c + 1, 0);
+                topo.node_of[c] = node;
+            }
+            if(node > max_node)
+                max_node = node;
+        }
+        closedir(dir);
+        if(max_node >= 0)
+            topo.nodes = max_node + 1;
+    });
+    return topo;
+}
+
+int cpu_node(int cpu){
+    const numa_topology& topo = topology();
+    return cpu >= 0 && cpu < (int)topo.node_of.size() ? topo.node_of[cpu] : 0;
+}
+
+int numa_node_count(){
+    return topology().nodes;
+}
+
+std::vector<int> placement_cpus(){
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::vector<std::vector<int>> by_node(numa_node_count());
+    if(sched_getaffinity(0, sizeof(set), &set) == 0){
+        for(int c = 0; c < CPU_SETSIZE; ++c){
+            if(CPU_ISSET(c, &set))
+                by_node[cpu_node(c)].push_back(c);
+        }
+    }
+    std::vector<int> cpus;
+    for(size_t i = 0; ; ++i){
+        bool any = false;
+        for(auto& node : by_node){
+            if(i < node.size()){
+                cpus.push_back(node[i]);
+                any = true;
+            }
+        }
+        if(!any)
+            break;
+    }
+    if(cpus.empty())
+        cpus.push_back(0);
+    return cpus;
+}
+
+bool pin_thread(int cpu){
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if(err != 0){
+        fprintf(stderr, "[ERROR] pthread_setaffinity_np cpu %d failed: %s\n", cpu, strerror(err));
+        return false;
+    }
+    return true;
+}
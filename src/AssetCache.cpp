@@ -0,0 +1,148 @@
+#include "../include/AssetCache.hpp"
+#include "../include/FileCache.hpp"
+
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+
+AssetCache asset_cache;
+
+// 编辑器通常写临时文件再改名, 所以监视目录而不是文件
+static const uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF;
+
+static std::string dir_of(const std::string& path){
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+// path 是 asset 对应的文件, 或者它的预压缩版本
+static bool same_source(const std::string& asset_path, const std::string& path){
+    if(path.compare(0, asset_path.size(), asset_path) != 0)
+        return false;
+    std::string_view suffix = std::string_view(path).substr(asset_path.size());
+    for(int c = 0; c < CODING_COUNT; ++c){
+        if(suffix == coding_suffix((content_coding)c))
+            return true;
+    }
+    return false;
+}
+
+AssetCache::AssetCache(size_t max_file_size, size_t max_total)
+    : max_file_size_(max_file_size), max_total_(max_total), inotify_fd_(-1), assets_(std::make_shared<const asset_map>()), total_(0), generation_(0){}
+
+AssetCache::~AssetCache(){
+    if(inotify_fd_ >= 0)
+        close(inotify_fd_);
+}
+
+bool AssetCache::init(){
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotify_fd_ < 0){
+        perror("[ERROR] inotify_init1 failed, asset cache disabled");
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const cached_asset> AssetCache::find(std::string_view key) const{
+    if(inotify_fd_ < 0)
+        return nullptr;
+    std::shared_ptr<const asset_map> assets = std::atomic_load(&assets_);
+    auto it = assets->find(std::string(key));
+    return it == assets->end() ? nullptr : it->second.data;
+}
+
+bool AssetCache::watch(const std::string& path, uint64_t* generation){
+    if(inotify_fd_ < 0)
+        return false;
+    std::string dir = dir_of(path);
+    std::lock_guard<std::mutex> lg(mtx_);
+    if(dir_watches_.find(dir) == dir_watches_.end()){
+        int wd = inotify_add_watch(inotify_fd_, dir.c_str(), WATCH_EVENTS);
+        if(wd < 0){
+            perror("[ERROR] inotify_add_watch failed");
+            return false;
+        }
+        watch_dirs_[wd] = dir;
+        dir_watches_[dir] = wd;
+    }
+    *generation = generation_;
+    return true;
+}
+
+void AssetCache::insert(std::string_view key, const std::string& path, std::shared_ptr<const cached_asset> data, uint64_t generation){
+    std::lock_guard<std::mutex> lg(mtx_);
+    if(generation != generation_ || total_ + data->size() > max_total_)
+        return;
+    std::shared_ptr<const asset_map> old = std::atomic_load(&assets_);
+    if(old->find(std::string(key)) != old->end())
+        return;
+    std::shared_ptr<asset_map> assets = std::make_shared<asset_map>(*old);
+    total_ += data->size();
+    assets->emplace(std::string(key), asset{path, std::move(data)});
+    std::atomic_store(&assets_, std::shared_ptr<const asset_map>(std::move(assets)));
+}
+
+void AssetCache::invalidate(const std::string& path){
+    // sendfile 路径上的 fd 缓存也立即失效, 不必等到下一次 stat
+    file_cache.erase(path);
+    std::lock_guard<std::mutex> lg(mtx_);
+    ++generation_;
+    std::shared_ptr<const asset_map> old = std::atomic_load(&assets_);
+    std::shared_ptr<asset_map> assets;
+    for(auto& kv : *old){
+        if(!same_source(kv.second.path, path))
+            continue;
+        if(!assets)
+            assets = std::make_shared<asset_map>(*old);
+        total_ -= kv.second.data->size();
+        assets->erase(kv.first);
+    }
+    if(assets)
+        std::atomic_store(&assets_, std::shared_ptr<const asset_map>(std::move(assets)));
+}
+
+void AssetCache::handle_events(){
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while(true){
+        ssize_t n = read(inotify_fd_, buf, sizeof(buf));
+        if(n < 0){
+            if(errno == EINTR)
+                continue;
+            if(errno != EAGAIN)
+                perror("[ERROR] inotify read failed");
+            return;
+        }
+        for(char* p = buf; p < buf + n; ){
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            std::string dir;
+            {
+                std::lock_guard<std::mutex> lg(mtx_);
+                auto it = watch_dirs_.find(ev->wd);
+                if(it == watch_dirs_.end())
+                    continue;
+                dir = it->second;
+                // 目录本身被删除或移动, 监视已经失效, 下次 watch 时重新添加
+                if(ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)){
+                    dir_watches_.erase(dir);
+                    watch_dirs_.erase(it);
+                }
+            }
+            if(ev->len > 0){
+                invalidate(dir == "." ? std::string(ev->name) : dir + "/" + ev->name);
+            }
+            else if(ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)){
+                // 整个目录失效, 清掉其中所有文件
+                std::string prefix = dir == "." ? "" : dir + "/";
+                std::shared_ptr<const asset_map> assets = std::atomic_load(&assets_);
+                for(auto& kv : *assets){
+                    if(kv.second.path.compare(0, prefix.size(), prefix) == 0)
+                        invalidate(kv.second.path);
+                }
+            }
+        }
+    }
+}
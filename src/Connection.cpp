@@ -0,0 +1,355 @@
+#include "../include/Connection.hpp"
+
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+
+timeout_config conn_timeouts = {10000, 60000, 600000, 30000};
+
+/******************************************************************* */
+// connection output queue
+uint64_t connection::idle_timeout() const{
+    // WebSocket 和 qt 都是长连接
+    return conn_type == WEBSOCKET || conn_type == QT ? conn_timeouts.ws_idle_ms : conn_timeouts.idle_ms;
+}
+
+// 持有 out_mtx 时调用, 任务结束或输出发完时设置下一个期限
+// 发送阻塞时按 write 超时; 留有不完整的 HTTP 请求时从它的第一个字节起按 header 超时; 否则按空闲超时
+void connection::reset_deadline_locked(){
+    if(!out_queue.empty())
+        touch(conn_timeouts.write_ms);
+    else if(conn_type == HTTP && request_start && conn_timeouts.header_ms)
+        deadline.store(request_start + conn_timeouts.header_ms, std::memory_order_release);
+    else
+        touch(idle_timeout());
+}
+
+// 持有 out_mtx 时调用, 把输出队列写到 EAGAIN 为止
+// 连续的内存段合并成一次 sendmsg, 文件段用 sendfile 直接从文件发送
+bool connection::flush_locked(){
+    // 流水线请求的一批响应 (每个响应头部和响应体各一段) 通常一次 sendmsg 就能发完
+    const int MAX_IOV = 128;
+    while(!out_queue.empty()){
+        out_chunk& front = out_queue.front();
+        if(front.file){
+            off_t off = front.offset;
+            ssize_t sent = sendfile(fd, front.file->fd, &off, front.end - front.offset);
+            if(sent < 0){
+                if(errno == EAGAIN || errno == EWOULDBLOCK)
+                    return true;
+                if(errno == EINTR)
+                    continue;
+                perror("[ERROR] sendfile failed");
+                return false;
+            }
+            // 文件在发送期间被截断, 剩下的部分已经无法发送, 只能断开
+            if(sent == 0){
+                fprintf(stderr, "[ERROR] sendfile: %s truncated\n", front.file->path.c_str());
+                return false;
+            }
+            front.offset += sent;
+            if(front.offset == front.end)
+                out_queue.pop_front();
+            continue;
+        }
+
+        struct iovec iov[MAX_IOV];
+        int n = 0;
+        auto it = out_queue.begin();
+        for(; it != out_queue.end() && !it->file && n < MAX_IOV; ++it, ++n){
+            iov[n].iov_base = (void*)(it->bytes() + it->offset);
+            iov[n].iov_len = it->size() - it->offset;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+        // 后面紧跟文件段 (通常是响应头部后面的响应体) 时让内核等文件数据一起组包
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL | (it != out_queue.end() && it->file ? MSG_MORE : 0));
+        if(sent < 0){
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if(errno == EINTR)
+                continue;
+            perror("[ERROR] send failed");
+            return false;
+        }
+        while(sent > 0){
+            out_chunk& first = out_queue.front();
+            size_t left = first.size() - first.offset;
+            if((size_t)sent < left){
+                first.offset += sent;
+                break;
+            }
+            sent -= left;
+            out_queue.pop_front();
+        }
+    }
+    if(shutdown_after_flush){
+        shutdown(fd, SHUT_WR);
+        shutdown_after_flush = false;
+    }
+    return true;
+}
+
+// 持有 out_mtx 时调用, 输出队列非空时同时关注 EPOLLOUT
+void connection::rearm_locked(){
+    // 已关闭的连接已经从 poller 中移除, 不能再注册回去; 持久注册不需要重新注册
+    if(closed || !oneshot)
+        return;
+    uint32_t events = EPOLLONESHOT | EPOLLERR | EPOLLHUP | EPOLLET;
+    // 不再读取时不关注 EPOLLIN/EPOLLRDHUP, 否则对端的 FIN 会反复触发
+    if(!input_closed.load(std::memory_order_relaxed))
+        events |= EPOLLIN | EPOLLRDHUP;
+    if(!out_queue.empty())
+        events |= EPOLLOUT;
+    poller->mod_fd(handle(), fd, events);
+}
+
+bool connection::send(std::string&& data){
+    if(data.empty())
+        return true;
+    std::lock_guard<std::mutex> lg(out_mtx);
+    if(closed)
+        return false;
+    bool was_empty = out_queue.empty();
+    out_queue.push_back(out_chunk(std::move(data)));
+    // 队列原本非空说明已经在等 EPOLLOUT, 只追加
+    if(!was_empty)
+        return true;
+    return send_locked();
+}
+
+bool connection::send(std::vector<out_chunk>&& parts){
+    std::lock_guard<std::mutex> lg(out_mtx);
+    if(closed)
+        return false;
+    bool was_empty = out_queue.empty();
+    for(out_chunk& part : parts){
+        if(part.offset < part.size())
+            out_queue.push_back(std::move(part));
+    }
+    parts.clear();
+    if(!was_empty || out_queue.empty())
+        return true;
+    return send_locked();
+}
+
+// 持有 out_mtx 且输出队列刚从空变为非空时调用
+bool connection::send_locked(){
+    if(!flush_locked())
+        return false;
+    // 有任务在执行时由 end_task 统一重新注册
+    if(!busy && !out_queue.empty()){
+        touch(conn_timeouts.write_ms);
+        rearm_locked();
+    }
+    return true;
+}
+
+bool connection::send(const void* data, size_t len){
+    return send(std::string((const char*)data, len));
+}
+
+bool connection::begin_task(){
+    if(input_closed.load(std::memory_order_acquire))
+        return false;
+    if(!oneshot){
+        // 持久注册不经过 epoll 保证互斥, 由 sched 状态决定由谁处理新数据
+        uint8_t s = sched.load(std::memory_order_acquire);
+        while(true){
+            if(s == IDLE){
+                if(sched.compare_exchange_weak(s, RUNNING, std::memory_order_acq_rel))
+                    break;
+            }
+            else if(s == RUNNING){
+                if(sched.compare_exchange_weak(s, NOTIFIED, std::memory_order_acq_rel))
+                    return false;
+            }
+            else
+                return false;
+        }
+    }
+    std::lock_guard<std::mutex> lg(out_mtx);
+    if(busy)
+        return false;
+    busy = true;
+    // 任务执行期间不会超时, 由 end_task 重新设置 deadline
+    deadline.store(NO_DEADLINE, std::memory_order_release);
+    return true;
+}
+
+bool connection::end_task(bool shutdown_wr){
+    std::lock_guard<std::mutex> lg(out_mtx);
+    if(!oneshot){
+        uint8_t s = RUNNING;
+        // 执行期间 reactor 又收到了 EPOLLIN, 边沿已经被消耗, 只能由当前任务继续读
+        // 关闭写端的连接不再处理新请求
+        if(!sched.compare_exchange_strong(s, IDLE, std::memory_order_acq_rel) && !shutdown_wr){
+            sched.store(RUNNING, std::memory_order_release);
+            return false;
+        }
+        sched.store(IDLE, std::memory_order_release);
+    }
+    busy = false;
+    if(shutdown_wr){
+        input_closed.store(true, std::memory_order_release);
+        if(out_queue.empty())
+            shutdown(fd, SHUT_WR);
+        else
+            shutdown_after_flush = true;
+    }
+    reset_deadline_locked();
+    rearm_locked();
+    return true;
+}
+
+bool connection::on_writable(bool rearm){
+    std::lock_guard<std::mutex> lg(out_mtx);
+    if(closed)
+        return false;
+    if(!flush_locked())
+        return false;
+    if(!busy){
+        reset_deadline_locked();
+        if(rearm)
+            rearm_locked();
+    }
+    return true;
+}
+
+void connection::mark_closed(){
+    std::lock_guard<std::mutex> lg(out_mtx);
+    closed = true;
+}
+
+bool connection::is_closed(){
+    std::lock_guard<std::mutex> lg(out_mtx);
+    return closed;
+}
+
+/******************************************************************* */
+// connection table
+ConnectionTable::ConnectionTable(size_t capacity) : capacity_(capacity){
+    if(capacity_ == 0){
+        struct rlimit rl;
+        if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+            capacity_ = rl.rlim_cur;
+        else
+            capacity_ = 65536;
+        // 上限 1M 个槽 (16MB)
+        if(capacity_ > (1 << 20))
+            capacity_ = 1 << 20;
+    }
+    slots_.reset(new slot[capacity_]);
+}
+
+ConnectionTable::~ConnectionTable(){
+    for(connection* conn : all_)
+        delete conn;
+}
+
+connection* ConnectionTable::open(int fd, connProto type, Poller* poller){
+    if(fd < 0 || (size_t)fd >= capacity_)
+        return nullptr;
+    connection* conn;
+    {
+        std::lock_guard<std::mutex> lg(pool_mtx_);
+        if(free_.empty()){
+            conn = new connection();
+            all_.push_back(conn);
+        }
+        else{
+            conn = free_.back();
+            free_.pop_back();
+        }
+    }
+    slot& s = slots_[fd];
+    uint32_t gen = s.gen.load(std::memory_order_relaxed) + 1;
+    // 代数 0 留给不在表中的 fd
+    if(gen == 0)
+        gen = 1;
+    conn->fd = fd;
+    conn->conn_type = type;
+    conn->poller = poller;
+    conn->gen.store(gen, std::memory_order_relaxed);
+    // 表的引用, release 顺序保证 acquire 到这个对象的线程能看到上面的字段
+    conn->refs.store(1, std::memory_order_release);
+    s.conn.store(conn, std::memory_order_release);
+    s.gen.store(gen, std::memory_order_release);
+    return conn;
+}
+
+void ConnectionTable::close(int fd){
+    if(fd < 0 || (size_t)fd >= capacity_)
+        return;
+    slot& s = slots_[fd];
+    connection* conn = s.conn.exchange(nullptr, std::memory_order_acq_rel);
+    s.gen.fetch_add(1, std::memory_order_acq_rel);
+    if(!conn)
+        return;
+    conn->mark_closed();
+    release(conn);
+}
+
+connection* ConnectionTable::acquire(conn_handle h){
+    int fd = handle_fd(h);
+    uint32_t gen = handle_gen(h);
+    if(fd < 0 || (size_t)fd >= capacity_ || gen == 0)
+        return nullptr;
+    slot& s = slots_[fd];
+    if(s.gen.load(std::memory_order_acquire) != gen)
+        return nullptr;
+    connection* conn = s.conn.load(std::memory_order_acquire);
+    if(!conn)
+        return nullptr;
+    // 引用为 0 说明已经在回收, 不能再复活
+    uint32_t refs = conn->refs.load(std::memory_order_relaxed);
+    do{
+        if(refs == 0)
+            return nullptr;
+    }while(!conn->refs.compare_exchange_weak(refs, refs + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+    // 拿到引用之后再确认对象没有被回收给别的连接
+    if(conn->fd != fd || conn->gen.load(std::memory_order_relaxed) != gen){
+        release(conn);
+        return nullptr;
+    }
+    return conn;
+}
+
+void ConnectionTable::release(connection* conn){
+    if(conn->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        recycle(conn);
+}
+
+// 最后一个引用释放时调用, 此时没有其他线程能访问这个连接
+void ConnectionTable::recycle(connection* conn){
+    ::close(conn->fd);
+    conn->username.clear();
+    conn->user_id = 0;
+    conn->qt_decoder.reset();
+    conn->http_parser.reset();
+    conn->in_buf.clear();
+    conn->ws_message.clear();
+    if(conn->ws_message.capacity() > 64 * 1024)
+        conn->ws_message.shrink_to_fit();
+    conn->ws_msg_opcode = 0;
+    // 放回池中的对象不保留过大的缓冲区
+    if(conn->in_buf.capacity() > 64 * 1024)
+        conn->in_buf.shrink_to_fit();
+    conn->deadline.store(connection::NO_DEADLINE, std::memory_order_relaxed);
+    conn->request_start = 0;
+    conn->out_queue.clear();
+    conn->busy = false;
+    conn->shutdown_after_flush = false;
+    conn->closed = false;
+    conn->input_closed.store(false, std::memory_order_relaxed);
+    conn->oneshot = true;
+    conn->sched.store(connection::IDLE, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lg(pool_mtx_);
+    free_.push_back(conn);
+}
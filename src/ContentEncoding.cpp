@@ -0,0 +1,159 @@
+#include "../include/ContentEncoding.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+const char* coding_name(content_coding coding){
+    switch (coding)
+    {
+    case CODING_GZIP:
+        return "gzip";
+    case CODING_BR:
+        return "br";
+    default:
+        return "";
+    }
+}
+
+const char* coding_suffix(content_coding coding){
+    switch (coding)
+    {
+    case CODING_GZIP:
+        return ".gz";
+    case CODING_BR:
+        return ".br";
+    default:
+        return "";
+    }
+}
+
+static bool token_equals(std::string_view token, const char* name){
+    size_t n = strlen(name);
+    return token.size() == n && strncasecmp(token.data(), name, n) == 0;
+}
+
+static std::string_view trim(std::string_view s){
+    while(!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+        s.remove_prefix(1);
+    while(!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+        s.remove_suffix(1);
+    return s;
+}
+
+// q 值放大 1000 倍, 缺省为 1
+static int parse_q(std::string_view params){
+    while(!params.empty()){
+        size_t semi = params.find(';');
+        std::string_view p = trim(params.substr(0, semi));
+        params = semi == std::string_view::npos ? std::string_view() : params.substr(semi + 1);
+        if(p.size() >= 2 && (p[0] == 'q' || p[0] == 'Q') && p[1] == '='){
+            std::string v(p.substr(2));
+            return (int)(atof(v.c_str()) * 1000 + 0.5);
+        }
+    }
+    return 1000;
+}
+
+content_coding negotiate_coding(std::string_view accept_encoding, const bool available[CODING_COUNT]){
+    // -1 表示没有提到; 没有提到的编码按 "*" 的 q 值, identity 缺省可接受
+    int q[CODING_COUNT];
+    int star = -1;
+    for(int i = 0; i < CODING_COUNT; ++i)
+        q[i] = -1;
+    while(!accept_encoding.empty()){
+        size_t comma = accept_encoding.find(',');
+        std::string_view item = accept_encoding.substr(0, comma);
+        accept_encoding = comma == std::string_view::npos ? std::string_view() : accept_encoding.substr(comma + 1);
+        size_t semi = item.find(';');
+        std::string_view token = trim(item.substr(0, semi));
+        int value = semi == std::string_view::npos ? 1000 : parse_q(item.substr(semi + 1));
+        if(token == "*")
+            star = value;
+        else if(token_equals(token, "gzip") || token_equals(token, "x-gzip"))
+            q[CODING_GZIP] = value;
+        else if(token_equals(token, "br"))
+            q[CODING_BR] = value;
+        else if(token_equals(token, "identity"))
+            q[CODING_IDENTITY] = value;
+    }
+
+    content_coding best = CODING_IDENTITY;
+    int best_q = 0;
+    for(int i = 0; i < CODING_COUNT; ++i){
+        if(!available[i])
+            continue;
+        int v = q[i] >= 0 ? q[i] : star >= 0 ? star : (i == CODING_IDENTITY ? 1 : 0);
+        if(v > 0 && v >= best_q){
+            best = (content_coding)i;
+            best_q = v;
+        }
+    }
+    return best;
+}
+
+bool compressible_mime(std::string_view mime_type){
+    return mime_type.compare(0, 5, "text/") == 0
+        || mime_type.compare(0, 22, "application/javascript") == 0
+        || mime_type.compare(0, 16, "application/json") == 0
+        || mime_type.compare(0, 15, "application/xml") == 0
+        || mime_type.compare(0, 13, "image/svg+xml") == 0
+        || mime_type.compare(0, 12, "image/x-icon") == 0;
+}
+
+bool can_compress(content_coding coding){
+#ifdef HAVE_BROTLI
+    return coding == CODING_GZIP || coding == CODING_BR;
+#else
+    return coding == CODING_GZIP;
+#endif
+}
+
+static bool gzip_compress(std::string_view in, std::string& out){
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits 15 + 16: 输出 gzip 头部和尾部; 每个版本只压缩一次, 用最高压缩级别
+    if(deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in = (Bytef*)in.data();
+    zs.avail_in = in.size();
+    zs.next_out = (Bytef*)&out[0];
+    zs.avail_out = out.size();
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+#ifdef HAVE_BROTLI
+static bool brotli_compress(std::string_view in, std::string& out){
+    size_t size = BrotliEncoderMaxCompressedSize(in.size());
+    if(size == 0)
+        return false;
+    out.resize(size);
+    // quality 11 对几百 KB 的文件要几百毫秒, 会占住工作线程, 用 9
+    if(!BrotliEncoderCompress(9, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC, in.size(), (const uint8_t*)in.data(), &size, (uint8_t*)&out[0]))
+        return false;
+    out.resize(size);
+    return true;
+}
+#endif
+
+bool compress_body(content_coding coding, std::string_view in, std::string& out){
+    switch (coding)
+    {
+    case CODING_GZIP:
+        return gzip_compress(in, out);
+#ifdef HAVE_BROTLI
+    case CODING_BR:
+        return brotli_compress(in, out);
+#endif
+    default:
+        return false;
+    }
+}
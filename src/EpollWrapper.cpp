@@ -20,9 +20,9 @@ bool EpollWrapper::add_fd(int fd, uint32_t events){
     return true;
 };
 
-bool EpollWrapper::add_fd(void* conn, int fd, uint32_t events){
+bool EpollWrapper::add_fd(uint64_t data, int fd, uint32_t events){
     struct epoll_event event;
-    event.data.ptr = conn;
+    event.data.u64 = data;
     event.events = events;
 
     if(epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &event) < 0)
@@ -40,9 +40,9 @@ bool EpollWrapper::mod_fd(int fd, uint32_t events){
     return true;
 };
 
-bool EpollWrapper::mod_fd(void* conn, int fd, uint32_t events){
+bool EpollWrapper::mod_fd(uint64_t data, int fd, uint32_t events){
     struct epoll_event event;
-    event.data.ptr = conn;
+    event.data.u64 = data;
     event.events = events;
 
     if(epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &event) < 0)
@@ -56,8 +56,8 @@ bool EpollWrapper::del_fd(int fd){
     return true;
 };
 
-int EpollWrapper::wait(){
-    return epoll_wait(epfd_, &*events_.begin(), MAXEVENTS, -1);
+int EpollWrapper::wait(int timeout){
+    return epoll_wait(epfd_, &*events_.begin(), MAXEVENTS, timeout);
 };
 
 mystl::vector<epoll_event>::iterator EpollWrapper::get_events(){
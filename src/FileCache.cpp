@@ -0,0 +1,134 @@
+#include "../include/FileCache.hpp"
+#include "../include/HttpData.hpp"
+#include "../include/TimingWheel.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+
+FileCache file_cache;
+
+open_file::~open_file(){
+    if(fd >= 0)
+        ::close(fd);
+}
+
+FileCache::FileCache(size_t capacity, uint64_t revalidate_ms) : capacity_(capacity ? capacity : 1), revalidate_ms_(revalidate_ms){}
+
+std::shared_ptr<const open_file> FileCache::open_path(const std::string& path){
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return nullptr;
+    std::shared_ptr<open_file> file = std::make_shared<open_file>();
+    file->fd = fd;
+    struct stat st;
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+        return nullptr;
+    file->path = path;
+    file->mime_type = get_mime_type(path);
+    file->size = st.st_size;
+    file->mtime = st.st_mtim;
+    file->ino = st.st_ino;
+    file->dev = st.st_dev;
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx-%lx%09lx\"", (unsigned long)st.st_ino, (unsigned long)st.st_size,
+             (unsigned long)st.st_mtim.tv_sec, (unsigned long)st.st_mtim.tv_nsec);
+    file->etag = etag;
+    file->last_modified = http_date(st.st_mtim.tv_sec);
+    return file;
+}
+
+// 与打开时的 fstat 信息不同说明文件被修改或替换了
+static bool same_file(const open_file& file, const struct stat& st){
+    return file.ino == st.st_ino && file.dev == st.st_dev && file.size == (size_t)st.st_size
+        && file.mtime.tv_sec == st.st_mtim.tv_sec && file.mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+bool read_open_file(const open_file& file, std::string& out){
+    out.resize(file.size);
+    size_t done = 0;
+    while(done < file.size){
+        ssize_t n = pread(file.fd, &out[done], file.size - done, done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+bool open_file_current(const open_file& file){
+    struct stat st;
+    return stat(file.path.c_str(), &st) == 0 && same_file(file, st);
+}
+
+std::shared_ptr<const open_file> FileCache::open(const std::string& path){
+    uint64_t now = TimingWheel::now_ms();
+    std::shared_ptr<const open_file> file;
+    {
+        std::lock_guard<std::mutex> lg(mtx_);
+        auto it = entries_.find(path);
+        if(it != entries_.end()){
+            entry& e = it->second;
+            lru_.splice(lru_.begin(), lru_, e.lru);
+            if(now - e.checked_ms < revalidate_ms_)
+                return e.file;
+            file = e.file;
+        }
+    }
+
+    // stat 和 open 不持有锁, 同一路径并发未命中时各自打开, 后插入的覆盖先插入的
+    struct stat st;
+    if(file && stat(path.c_str(), &st) == 0 && same_file(*file, st)){
+        std::lock_guard<std::mutex> lg(mtx_);
+        auto it = entries_.find(path);
+        if(it != entries_.end() && it->second.file == file)
+            it->second.checked_ms = now;
+        return file;
+    }
+
+    file = open_path(path);
+    std::lock_guard<std::mutex> lg(mtx_);
+    auto it = entries_.find(path);
+    if(!file){
+        if(it != entries_.end()){
+            lru_.erase(it->second.lru);
+            entries_.erase(it);
+        }
+        return nullptr;
+    }
+    if(it != entries_.end()){
+        it->second.file = file;
+        it->second.checked_ms = now;
+        return file;
+    }
+    lru_.push_front(path);
+    entries_.emplace(path, entry{file, now, lru_.begin()});
+    while(entries_.size() > capacity_){
+        entries_.erase(lru_.back());
+        lru_.pop_back();
+    }
+    return file;
+}
+
+void FileCache::erase(const std::string& path){
+    std::lock_guard<std::mutex> lg(mtx_);
+    auto it = entries_.find(path);
+    if(it == entries_.end())
+        return;
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+}
+
+void FileCache::clear(){
+    std::lock_guard<std::mutex> lg(mtx_);
+    entries_.clear();
+    lru_.clear();
+}
+
+size_t FileCache::size(){
+    std::lock_guard<std::mutex> lg(mtx_);
+    return entries_.size();
+}
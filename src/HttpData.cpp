@@ -1,117 +1,121 @@
 #include "../include/HttpData.hpp"
+#include "../include/HttpParser.hpp"
+#include "../include/AssetCache.hpp"
+
+#include <string.h>
+#include <strings.h>
+#include <charconv>
+#include <algorithm>
+#include <atomic>
+
+static int hex_value(char c){
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
 
-std::string utf8_decode(const std::string& str)
-{
-    std::string decoded;
-    decoded.reserve(str.size());  // 先分配足够空间
-
-    for (size_t i = 0; i < str.size(); ++i) {
-        char c = str[i];
-        if (c == '%') {
-            // 若剩余长度不足2，说明格式错误，这里简单处理
-            if (i + 2 < str.size()) {
-                // 解析 '%xx' 两位十六进制
-                std::string hexValue = str.substr(i+1, 2);
-                // 将hexValue转为int
-                unsigned int val;
-                std::istringstream iss(hexValue);
-                iss >> std::hex >> val;
-                // 放入decoded字符串
-                decoded.push_back(static_cast<char>(val));
-                i += 2; // 跳过这2位
-            }
-            // 若不够2位，这里你可根据需求处理错误
-        } 
+size_t url_decode(char* s, size_t len){
+    // 解码后不会变长, 可以直接写回原处
+    size_t out = 0;
+    for (size_t i = 0; i < len; ++i) {
+        char c = s[i];
+        if (c == '%' && i + 2 < len && hex_value(s[i + 1]) >= 0 && hex_value(s[i + 2]) >= 0) {
+            s[out++] = (char)(hex_value(s[i + 1]) * 16 + hex_value(s[i + 2]));
+            i += 2;
+        }
         else if (c == '+') {
             // 有些情况下 '+' 表示空格
-            decoded.push_back(' ');
+            s[out++] = ' ';
         }
         else {
-            // 普通字符原样加入
-            decoded.push_back(c);
+            // 普通字符和不完整的 %xx 原样保留
+            s[out++] = c;
         }
     }
-
-    return decoded;
+    return out;
 }
 
-void parse_url(HttpRequest& request, const std::string& url){
-    auto pos = url.find('?');
-    std::string qs;
-    if(pos == std::string::npos){
-        request.url_ = url;
-    }
-    else{
-        request.url_ = url.substr(0, pos);
-        qs = url.substr(pos + 1);
-    }
-    if(qs.empty())
+void parse_url(HttpRequest& request, char* url, size_t len){
+    char* end = url + len;
+    char* qs = (char*)memchr(url, '?', len);
+    request.url_ = std::string_view(url, (qs ? qs : end) - url);
+    request.query_count_ = 0;
+    if(!qs)
         return;
-    std::istringstream iss(qs);
-    std::string kv;
-    while(std::getline(iss, kv, '&')){
-        auto pos = kv.find('=');
-        if(pos == std::string::npos){
-            request.query_params_[kv] = "";
-        }
-        else{
-            auto key = kv.substr(0, pos);
-            auto value = utf8_decode(kv.substr(pos + 1));
-            request.query_params_[key] = value;
+    // 超出 HTTP_MAX_QUERY_PARAMS 的参数被忽略
+    char* p = qs + 1;
+    while(p < end && request.query_count_ < HTTP_MAX_QUERY_PARAMS){
+        char* amp = (char*)memchr(p, '&', end - p);
+        char* kv_end = amp ? amp : end;
+        if(kv_end != p){
+            http_field& f = request.query_params_[request.query_count_++];
+            char* eq = (char*)memchr(p, '=', kv_end - p);
+            if(!eq){
+                f.key = std::string_view(p, kv_end - p);
+                f.value = std::string_view();
+            }
+            else{
+                f.key = std::string_view(p, eq - p);
+                f.value = std::string_view(eq + 1, url_decode(eq + 1, kv_end - eq - 1));
+            }
         }
+        p = kv_end + 1;
     }
 }
 
-HttpRequest parse_HttpRequest(const std::string& request){
-    std::istringstream stream(request);
-    HttpRequest req;
-    std::string line;
-
-    if(std::getline(stream, line)){
-        std::istringstream line_stream(line);
-        std::string method_str, url_str, version_str;
-        line_stream >> method_str >> url_str >> version_str;
-        req.method_ = method_map_.find(method_str)->second;
-        req.version_ = version_map_.find(version_str)->second;
-        parse_url(req, url_str);
+const http_field* HttpRequest::find_header(std::string_view key) const{
+    for(size_t i = 0; i < header_count_; ++i){
+        const http_field& f = headers_[i];
+        if(f.key.size() == key.size() && strncasecmp(f.key.data(), key.data(), key.size()) == 0)
+            return &f;
     }
+    return nullptr;
+}
 
-    while(std::getline(stream, line) && line != "\r"){
-        size_t pos = line.find(": ");
-        if (pos != std::string::npos) {
-            std::string key = line.substr(0, pos);
-            std::string value = line.substr(pos + 2);
-            if (!value.empty() && value.back() == '\r') {
-                value.pop_back();
-            }
-            req.headers_[key] = value;
-        }
-    }
+std::string_view HttpRequest::header(std::string_view key) const{
+    const http_field* f = find_header(key);
+    return f ? f->value : std::string_view();
+}
 
-    if (req.headers_.count("Content-Length")) {
-        size_t content_length = std::stoul(req.headers_["Content-Length"]);  // 获取 `Content-Length`
-        req.body.resize(content_length);  // 预分配 `body` 空间
-        stream.read(&req.body[0], content_length);  // **精确读取 `content_length` 字节**
-    }
+std::string_view HttpRequest::query(std::string_view key) const{
+    for(size_t i = 0; i < query_count_; ++i)
+        if(query_params_[i].key == key)
+            return query_params_[i].value;
+    return std::string_view();
+}
 
-    //Connection
-    if(req.headers_["Connection"] == "keep-alive")
-        req.keep_alive_ = true;
-    else
-        req.keep_alive_ = false;
+bool HttpRequest::has_query(std::string_view key) const{
+    for(size_t i = 0; i < query_count_; ++i)
+        if(query_params_[i].key == key)
+            return true;
+    return false;
+}
+
+std::string_view HttpRequest::param(std::string_view key) const{
+    for(size_t i = 0; i < route_param_count_; ++i)
+        if(route_params_[i].key == key)
+            return route_params_[i].value;
+    return std::string_view();
+}
 
-    return req;
+// 一次性解析完整的请求, 请求不完整或格式错误时返回的请求中字段为空
+HttpRequest parse_HttpRequest(std::string& request){
+    HttpParser parser;
+    parser.parse(&request[0], request.size());
+    return parser.request();
 }
 
-std::string url_to_filePath(const std::string& url){
-    if(url.find("..") != std::string::npos){
+std::string url_to_filePath(std::string_view url){
+    if(url.empty() || url.find("..") != std::string_view::npos){
         return "";
     }
-    if(file_path.find(url) != file_path.end()){
-        return file_path.at(url);
+    auto iter = file_path.find(std::string(url));
+    if(iter != file_path.end()){
+        return iter->second;
     }
 
-    return url.substr(1);
+    return std::string(url.substr(1));
 }
 
 std::string get_mime_type(const std::string &filename){
@@ -137,8 +141,8 @@ std::string formatHttpRequest(const HttpRequest& request) {
            << version_to_string.at(request.version_) << "\r\n";
 
     // 2. 请求头
-    for (const auto& [key, value] : request.headers_) {
-        output << key << ": " << value << "\r\n";
+    for (size_t i = 0; i < request.header_count_; ++i) {
+        output << request.headers_[i].key << ": " << request.headers_[i].value << "\r\n";
     }
 
     // 3. 空行（分隔请求头和请求体）
@@ -174,6 +178,208 @@ std::string calculate_websocket_accept(const std::string& key){
     return accept_value;
 }
 
+std::string http_date(time_t t){
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    size_t n = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buf, n);
+}
+
+bool parse_http_date(std::string_view s, time_t* t){
+    char buf[64];
+    if(s.size() >= sizeof(buf))
+        return false;
+    memcpy(buf, s.data(), s.size());
+    buf[s.size()] = '\0';
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if(!end || *end != '\0')
+        return false;
+    *t = timegm(&tm);
+    return true;
+}
+
+// If-None-Match 中是否有与 etag 相同的项, 按弱比较 (忽略 W/ 前缀)
+static bool etag_matches(std::string_view list, std::string_view etag){
+    size_t pos = 0;
+    while(pos < list.size()){
+        while(pos < list.size() && (list[pos] == ' ' || list[pos] == '\t' || list[pos] == ','))
+            ++pos;
+        if(pos >= list.size())
+            break;
+        if(list[pos] == '*')
+            return true;
+        if(list.compare(pos, 2, "W/") == 0)
+            pos += 2;
+        size_t end = list.find('"', pos + 1);
+        if(list[pos] != '"' || end == std::string_view::npos)
+            return false;
+        if(list.substr(pos, end + 1 - pos) == etag)
+            return true;
+        pos = end + 1;
+    }
+    return false;
+}
+
+bool request_not_modified(const HttpRequest& request, std::string_view etag, time_t mtime){
+    if(request.method_ != HttpMethod::GET && request.method_ != HttpMethod::HEAD)
+        return false;
+    const http_field* inm = request.find_header("If-None-Match");
+    if(inm)
+        return etag_matches(inm->value, etag);
+    const http_field* ims = request.find_header("If-Modified-Since");
+    time_t since;
+    return ims && parse_http_date(ims->value, &since) && mtime <= since;
+}
+
+// Range: bytes=0-499, 500-, -200; 按起点排序并合并重叠或相邻的区间
+// 返回 RANGE_IGNORE 时按普通请求返回整个文件
+enum range_result { RANGE_IGNORE, RANGE_OK, RANGE_UNSATISFIABLE };
+const size_t HTTP_MAX_RANGES = 16;
+
+static range_result parse_range(std::string_view spec, size_t size, std::vector<std::pair<size_t, size_t>>& ranges){
+    if(spec.compare(0, 6, "bytes=") != 0)
+        return RANGE_IGNORE;
+    spec.remove_prefix(6);
+    size_t count = 0;
+    while(!spec.empty()){
+        size_t comma = spec.find(',');
+        std::string_view item = spec.substr(0, comma);
+        spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+        while(!item.empty() && (item.front() == ' ' || item.front() == '\t'))
+            item.remove_prefix(1);
+        while(!item.empty() && (item.back() == ' ' || item.back() == '\t'))
+            item.remove_suffix(1);
+        if(item.empty())
+            continue;
+        if(++count > HTTP_MAX_RANGES)
+            return RANGE_IGNORE;
+
+        size_t dash = item.find('-');
+        if(dash == std::string_view::npos)
+            return RANGE_IGNORE;
+        std::string_view first_s = item.substr(0, dash), last_s = item.substr(dash + 1);
+        size_t first = 0, last = 0;
+        if(!first_s.empty() && std::from_chars(first_s.data(), first_s.data() + first_s.size(), first).ptr != first_s.data() + first_s.size())
+            return RANGE_IGNORE;
+        if(!last_s.empty() && std::from_chars(last_s.data(), last_s.data() + last_s.size(), last).ptr != last_s.data() + last_s.size())
+            return RANGE_IGNORE;
+
+        size_t begin, end;
+        if(first_s.empty()){
+            // 后缀区间: 最后 last 个字节
+            if(last_s.empty())
+                return RANGE_IGNORE;
+            if(last == 0 || size == 0)
+                continue;
+            begin = last >= size ? 0 : size - last;
+            end = size;
+        }
+        else{
+            if(!last_s.empty() && last < first)
+                return RANGE_IGNORE;
+            if(first >= size)
+                continue;
+            begin = first;
+            end = last_s.empty() || last >= size ? size : last + 1;
+        }
+        ranges.emplace_back(begin, end);
+    }
+    if(count == 0)
+        return RANGE_IGNORE;
+    if(ranges.empty())
+        return RANGE_UNSATISFIABLE;
+
+    std::sort(ranges.begin(), ranges.end());
+    size_t n = 0;
+    for(size_t i = 1; i < ranges.size(); ++i){
+        if(ranges[i].first <= ranges[n].second)
+            ranges[n].second = std::max(ranges[n].second, ranges[i].second);
+        else
+            ranges[++n] = ranges[i];
+    }
+    ranges.resize(n + 1);
+    return RANGE_OK;
+}
+
+// If-Range 是 ETag 时必须强匹配, 是日期时必须与 Last-Modified 相同, 否则忽略 Range 返回整个文件
+static bool if_range_matches(const HttpRequest& request, const open_file& file){
+    const http_field* if_range = request.find_header("If-Range");
+    if(!if_range)
+        return true;
+    if(!if_range->value.empty() && if_range->value[0] == '"')
+        return if_range->value == file.etag;
+    time_t t;
+    return parse_http_date(if_range->value, &t) && t == file.mtime.tv_sec;
+}
+
+static std::string content_range(size_t begin, size_t end, size_t size){
+    return "bytes " + std::to_string(begin) + "-" + std::to_string(end - 1) + "/" + std::to_string(size);
+}
+
+// 206 / 416; 返回 false 表示不按 Range 处理
+static bool make_range_response(const HttpRequest& http_request_, const std::shared_ptr<const open_file>& file, HttpResponse& http_response_){
+    const http_field* range = http_request_.find_header("Range");
+    if(!range || http_request_.method_ != HttpMethod::GET || !if_range_matches(http_request_, *file))
+        return false;
+    std::vector<std::pair<size_t, size_t>> ranges;
+    range_result result = parse_range(range->value, file->size, ranges);
+    if(result == RANGE_IGNORE)
+        return false;
+
+    http_response_.set_header("Accept-Ranges", "bytes");
+    http_response_.set_header("ETag", file->etag);
+    http_response_.set_header("Last-Modified", file->last_modified);
+    if(result == RANGE_UNSATISFIABLE){
+        http_response_.set_statusCode(416);
+        http_response_.set_reasonPhrase("Range Not Satisfiable");
+        http_response_.set_header("Content-Range", "bytes */" + std::to_string(file->size));
+        return true;
+    }
+
+    http_response_.set_statusCode(206);
+    http_response_.set_reasonPhrase("Partial Content");
+    if(ranges.size() == 1){
+        http_response_.set_header("Content-Type", file->mime_type);
+        http_response_.set_header("Content-Range", content_range(ranges[0].first, ranges[0].second, file->size));
+        http_response_.set_file(file, ranges[0].first, ranges[0].second);
+        return true;
+    }
+
+    // multipart/byteranges: 每个区间前是一段内存中的分隔行和头部, 区间本身由 sendfile 发送
+    static std::atomic<uint64_t> boundary_seq(0);
+    char boundary[48];
+    snprintf(boundary, sizeof(boundary), "byteranges_%016lx%08lx",
+             (unsigned long)file->mtime.tv_nsec ^ (unsigned long)file->ino, (unsigned long)boundary_seq.fetch_add(1, std::memory_order_relaxed));
+    http_response_.set_header("Content-Type", std::string("multipart/byteranges; boundary=") + boundary);
+    for(size_t i = 0; i < ranges.size(); ++i){
+        std::string part = i == 0 ? "--" : "\r\n--";
+        part += boundary;
+        part += "\r\nContent-Type: ";
+        part += file->mime_type;
+        part += "\r\nContent-Range: ";
+        part += content_range(ranges[i].first, ranges[i].second, file->size);
+        part += "\r\n\r\n";
+        http_response_.append_body(std::make_shared<const std::string>(std::move(part)));
+        http_response_.append_file(file, ranges[i].first, ranges[i].second);
+    }
+    http_response_.append_body(std::make_shared<const std::string>(std::string("\r\n--") + boundary + "--\r\n"));
+    return true;
+}
+
+static HttpResponse make_not_modified_response(std::string_view etag, std::string_view last_modified, bool vary){
+    HttpResponse http_response_;
+    http_response_.set_statusCode(304);
+    http_response_.set_reasonPhrase("Not Modified");
+    http_response_.set_header("ETag", std::string(etag));
+    http_response_.set_header("Last-Modified", std::string(last_modified));
+    if(vary)
+        http_response_.set_header("Vary", "Accept-Encoding");
+    return http_response_;
+}
+
 /******************************************************************* */
 // Http response functions
 void HttpResponse::set_version(const std::string& version){
@@ -189,43 +395,214 @@ void HttpResponse::set_reasonPhrase(const std::string& reason){
 }
 
 void HttpResponse::set_header(const std::string& key, const std::string& value){
-    headers_[key] = value;
+    for(auto& kv : headers_){
+        if(kv.first == key){
+            kv.second = value;
+            return;
+        }
+    }
+    headers_.emplace_back(key, value);
 }
 
 void HttpResponse::set_body(const std::string& body) {
-    body_ = body;
+    set_body(std::make_shared<const std::string>(body));
 }
 
-std::string HttpResponse::HttpResponse_to_string() const{
-    std::ostringstream response;
+void HttpResponse::set_body(std::string&& body) {
+    set_body(std::make_shared<const std::string>(std::move(body)));
+}
 
-    response << version_ << " " << status_code_ << " " << reason_phrase_ << "\r\n";
+void HttpResponse::set_body(std::shared_ptr<const std::string> body) {
+    body_.clear();
+    body_size_ = 0;
+    append_body(std::move(body));
+}
 
-    if(headers_.find("Content-Length") == headers_.end()){
-        response << "Content-Length: " << body_.size() << "\r\n";
-    }
+void HttpResponse::set_file(std::shared_ptr<const open_file> file, size_t begin, size_t end){
+    body_.clear();
+    body_size_ = 0;
+    append_file(std::move(file), begin, end);
+}
 
+void HttpResponse::append_body(std::shared_ptr<const std::string> body){
+    if(body->empty())
+        return;
+    body_size_ += body->size();
+    body_.push_back(body_part{std::move(body), nullptr, 0, 0});
+}
+
+void HttpResponse::append_file(std::shared_ptr<const open_file> file, size_t begin, size_t end){
+    if(begin >= end)
+        return;
+    body_size_ += end - begin;
+    body_.push_back(body_part{nullptr, std::move(file), begin, end});
+}
+
+static void append_number(std::string& out, size_t n){
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), n);
+    out.append(buf, res.ptr - buf);
+}
+
+void HttpResponse::write_head(std::string& out) const{
+    out += version_;
+    out += ' ';
+    append_number(out, status_code_);
+    out += ' ';
+    out += reason_phrase_;
+    out += "\r\n";
+
+    bool has_length = false;
     for (auto &kv : headers_) {
-        response << kv.first << ": " << kv.second << "\r\n";
+        has_length = has_length || kv.first == "Content-Length";
+        out += kv.first;
+        out += ": ";
+        out += kv.second;
+        out += "\r\n";
+    }
+    // 1xx, 204 和 304 没有响应体, 也不带 Content-Length
+    if(!has_length && status_code_ >= 200 && status_code_ != 204 && status_code_ != 304){
+        out += "Content-Length: ";
+        append_number(out, body_size());
+        out += "\r\n";
     }
 
-    response << "\r\n";
+    out += "\r\n";
+}
 
-    response << body_;
+// 同一个文件的不同编码是不同的表示, ETag 不同: 在编码来源文件的 ETag 的引号内加上编码名
+static std::string coding_etag(const std::string& etag, content_coding coding){
+    if(coding == CODING_IDENTITY)
+        return etag;
+    return etag.substr(0, etag.size() - 1) + "-" + coding_name(coding) + "\"";
+}
 
-    return response.str();
+// 预压缩的同名文件 (index.html.gz), 比原文件旧时不使用
+static std::shared_ptr<const open_file> open_precompressed(const open_file& file, content_coding coding){
+    std::shared_ptr<const open_file> sibling = file_cache.open(file.path + coding_suffix(coding));
+    if(!sibling)
+        return nullptr;
+    if(sibling->mtime.tv_sec < file.mtime.tv_sec || (sibling->mtime.tv_sec == file.mtime.tv_sec && sibling->mtime.tv_nsec < file.mtime.tv_nsec))
+        return nullptr;
+    return sibling;
 }
 
+static void set_file_headers(HttpResponse& http_response_, const open_file& file, content_coding coding, const std::string& etag, bool vary){
+    http_response_.set_header("Content-Type", file.mime_type);
+    if(coding != CODING_IDENTITY)
+        http_response_.set_header("Content-Encoding", coding_name(coding));
+    else
+        http_response_.set_header("Accept-Ranges", "bytes");
+    http_response_.set_header("ETag", etag);
+    http_response_.set_header("Last-Modified", file.last_modified);
+    if(vary)
+        http_response_.set_header("Vary", "Accept-Encoding");
+}
+
+// 静态文件: 小文件的所有编码版本预先拼成完整响应缓存在 asset_cache 中, 命中时直接返回;
+// 其他文件从 file_cache 取得打开的 fd, 响应体由 sendfile 发送, 不读入内存, 只使用预压缩的同名文件
+// 条件请求在读文件之前判断, 只用缓存的或 fstat 得到的 ETag 和修改时间
 HttpResponse make_ok_response(const HttpRequest& http_request_){
     HttpResponse http_response_;
+    // 缓存的响应按 HTTP/1.1 构建
+    bool cacheable = http_request_.version_ == HttpVersion::HTTP_1_1;
+    // Range 请求从文件发送所需的区间, 不使用缓存的完整响应, 也不压缩
+    bool ranged = http_request_.has_header("Range");
+    std::string_view accept_encoding = http_request_.header("Accept-Encoding");
+    if(cacheable && !ranged){
+        std::shared_ptr<const cached_asset> cached = asset_cache.find(http_request_.url_);
+        if(cached){
+            bool available[CODING_COUNT];
+            for(int c = 0; c < CODING_COUNT; ++c)
+                available[c] = !cached->responses[c].empty();
+            content_coding coding = negotiate_coding(accept_encoding, available);
+            if(request_not_modified(http_request_, cached->etags[coding], cached->mtime))
+                return make_not_modified_response(cached->etags[coding], cached->last_modified, cached->vary);
+            http_response_.set_prebuilt(std::shared_ptr<const std::string>(cached, &cached->responses[coding]));
+            return http_response_;
+        }
+    }
 
     std::string file_path_ = url_to_filePath(http_request_.url_);
-    std::string mime_type_ = get_mime_type(file_path_);
-    std::string content = file_get_content(file_path_, mime_type_);
+    // 先开始监视目录再读文件, 读的过程中文件被修改时这次的内容不会进入缓存
+    uint64_t generation = 0;
+    cacheable = cacheable && !file_path_.empty() && asset_cache.watch(file_path_, &generation);
+    std::shared_ptr<const open_file> file = file_path_.empty() ? nullptr : file_cache.open(file_path_);
+    if(!file){
+        http_response_.set_version(version_to_string.at(http_request_.version_));
+        http_response_.set_statusCode(404);
+        http_response_.set_reasonPhrase("Not Found");
+        http_response_.set_body("Not Found");
+        return http_response_;
+    }
+    cacheable = cacheable && file->size <= asset_cache.max_file_size();
+    bool vary = compressible_mime(file->mime_type);
+
+    // 可用的编码: 有新的预压缩文件, 或者是要放进缓存的小文件 (即时压缩一次)
+    std::shared_ptr<const open_file> sources[CODING_COUNT];
+    bool available[CODING_COUNT] = {true};
+    std::string etags[CODING_COUNT];
+    sources[CODING_IDENTITY] = file;
+    etags[CODING_IDENTITY] = file->etag;
+    for(int c = CODING_IDENTITY + 1; c < CODING_COUNT && vary && !ranged; ++c){
+        sources[c] = open_precompressed(*file, (content_coding)c);
+        available[c] = sources[c] || (cacheable && can_compress((content_coding)c));
+        if(available[c])
+            etags[c] = coding_etag((sources[c] ? sources[c] : file)->etag, (content_coding)c);
+    }
+    content_coding coding = negotiate_coding(accept_encoding, available);
+    if(request_not_modified(http_request_, etags[coding], file->mtime.tv_sec)){
+        http_response_ = make_not_modified_response(etags[coding], file->last_modified, vary);
+        http_response_.set_version(version_to_string.at(http_request_.version_));
+        return http_response_;
+    }
 
     http_response_.set_version(version_to_string.at(http_request_.version_));
-    http_response_.set_header("Content-Type", mime_type_);
-    http_response_.set_body(content);
+    if(make_range_response(http_request_, file, http_response_)){
+        if(vary)
+            http_response_.set_header("Vary", "Accept-Encoding");
+        return http_response_;
+    }
+
+    std::string content;
+    if(cacheable && !ranged && read_open_file(*file, content) && open_file_current(*file)){
+        std::shared_ptr<cached_asset> asset = std::make_shared<cached_asset>();
+        asset->last_modified = file->last_modified;
+        asset->mtime = file->mtime.tv_sec;
+        asset->vary = vary;
+        for(int c = 0; c < CODING_COUNT; ++c){
+            if(!available[c])
+                continue;
+            std::string encoded;
+            const std::string* body = &content;
+            if(c != CODING_IDENTITY){
+                // 预压缩文件优先, 否则压缩一次
+                bool ok = sources[c] ? read_open_file(*sources[c], encoded) : compress_body((content_coding)c, content, encoded);
+                if(!ok)
+                    continue;
+                body = &encoded;
+            }
+            // 头部按响应体的大小生成 Content-Length, 响应体直接接在头部后面, 不经过 HttpResponse
+            HttpResponse variant;
+            set_file_headers(variant, *file, (content_coding)c, etags[c], vary);
+            variant.set_header("Content-Length", std::to_string(body->size()));
+            asset->responses[c].reserve(256 + body->size());
+            variant.write_head(asset->responses[c]);
+            asset->responses[c].append(*body);
+            asset->etags[c] = etags[c];
+        }
+        if(asset->responses[coding].empty())
+            coding = CODING_IDENTITY;
+        http_response_.set_prebuilt(std::shared_ptr<const std::string>(asset, &asset->responses[coding]));
+        asset_cache.insert(http_request_.url_, file_path_, std::move(asset), generation);
+        return http_response_;
+    }
+
+    // 大文件只使用预压缩文件, 不即时压缩
+    if(!sources[coding])
+        coding = CODING_IDENTITY;
+    set_file_headers(http_response_, *file, coding, etags[coding], vary);
+    http_response_.set_file(sources[coding]);
 
     return http_response_;
 }
@@ -233,10 +610,10 @@ HttpResponse make_ok_response(const HttpRequest& http_request_){
 HttpResponse make_login_response(const HttpRequest& http_request_){
     HttpResponse http_response_;
 
-    std::string content_type_ = http_request_.headers_.at("Content-Type");
+    std::string_view content_type_ = http_request_.header("Content-Type");
 
     if(content_type_ == "application/json"){
-        myjson json = myjson::parse(http_request_.body);
+        myjson json = myjson::parse(std::string(http_request_.body));
         std::string username = json["username"];
         std::string password = json["password"];
         //to do
@@ -255,7 +632,7 @@ HttpResponse make_login_response(const HttpRequest& http_request_){
 
 HttpResponse make_upgrade_response(const HttpRequest& http_request_){
     HttpResponse http_response_;
-    std::string sec_key = http_request_.headers_.at("Sec-WebSocket-Key");
+    std::string sec_key(http_request_.header("Sec-WebSocket-Key"));
     http_response_.set_statusCode(101);
     http_response_.set_reasonPhrase("Switching Protocols");
     http_response_.set_header("Upgrade", "websocket");
@@ -0,0 +1,338 @@
+#include "../include/HttpParser.hpp"
+
+#include <string.h>
+#include <strings.h>
+
+static HttpMethod to_method(const char* p, size_t n){
+    switch (n)
+    {
+    case 3:
+        if(memcmp(p, "GET", 3) == 0) return HttpMethod::GET;
+        if(memcmp(p, "PUT", 3) == 0) return HttpMethod::PUT;
+        break;
+    case 4:
+        if(memcmp(p, "POST", 4) == 0) return HttpMethod::POST;
+        if(memcmp(p, "HEAD", 4) == 0) return HttpMethod::HEAD;
+        break;
+    case 5:
+        if(memcmp(p, "PATCH", 5) == 0) return HttpMethod::PATCH;
+        break;
+    case 6:
+        if(memcmp(p, "DELETE", 6) == 0) return HttpMethod::DELETE;
+        break;
+    case 7:
+        if(memcmp(p, "OPTIONS", 7) == 0) return HttpMethod::OPTIONS;
+        break;
+    }
+    return HttpMethod::UNKNOWN;
+}
+
+static HttpVersion to_version(const char* p, size_t n){
+    if(n != 8 || memcmp(p, "HTTP/", 5) != 0 || p[6] != '.')
+        return HttpVersion::UNKNOW;
+    if(p[5] == '1' && p[7] == '1') return HttpVersion::HTTP_1_1;
+    if(p[5] == '1' && p[7] == '0') return HttpVersion::HTTP_1_0;
+    if(p[5] == '2' && p[7] == '0') return HttpVersion::HTTP_2_0;
+    return HttpVersion::UNKNOW;
+}
+
+// Connection 头是逗号分隔、不区分大小写的选项列表
+// HTTP/1.1 缺省为持久连接, 带 close 时关闭; HTTP/1.0 只有带 keep-alive 时才保持
+static bool is_persistent(const HttpRequest& req){
+    std::string_view value = req.header("Connection");
+    bool close = false, keep_alive = false;
+    while(!value.empty()){
+        size_t comma = value.find(',');
+        std::string_view token = value.substr(0, comma);
+        value = comma == std::string_view::npos ? std::string_view() : value.substr(comma + 1);
+        while(!token.empty() && (token.front() == ' ' || token.front() == '\t'))
+            token.remove_prefix(1);
+        while(!token.empty() && (token.back() == ' ' || token.back() == '\t'))
+            token.remove_suffix(1);
+        if(token.size() == 5 && strncasecmp(token.data(), "close", 5) == 0)
+            close = true;
+        else if(token.size() == 10 && strncasecmp(token.data(), "keep-alive", 10) == 0)
+            keep_alive = true;
+    }
+    if(close)
+        return false;
+    return req.version_ == HttpVersion::HTTP_1_0 ? keep_alive : true;
+}
+
+void HttpParser::reset(){
+    state_ = STATE_PARSE_URI;
+    rl_state_ = RL_METHOD;
+    h_state_ = H_START;
+    pos_ = 0;
+    mark_ = 0;
+    key_begin_ = key_end_ = value_begin_ = value_end_ = 0;
+    body_begin_ = 0;
+    content_length_ = 0;
+    url_begin_ = url_len_ = 0;
+    span_count_ = 0;
+    error_status_ = 400;
+    // 定长数组只靠计数清空, 不必整体重新构造
+    req_.method_ = HttpMethod::UNKNOWN;
+    req_.version_ = HttpVersion::UNKNOW;
+    req_.url_ = std::string_view();
+    req_.query_count_ = 0;
+    req_.header_count_ = 0;
+    req_.keep_alive_ = false;
+    req_.body = std::string_view();
+    req_.route_param_count_ = 0;
+}
+
+size_t HttpParser::wanted() const{
+    if(state_ == STATE_PARSE_URI || state_ == STATE_PARSE_HEADERS)
+        return HTTP_MAX_HEADER_SIZE + 1;
+    if(state_ == STATE_RECV_BODY)
+        return body_begin_ + content_length_;
+    return pos_;
+}
+
+// 请求行或头部还不完整, 已经超过上限时不再等待
+HttpParseResult HttpParser::header_too_large(){
+    if(pos_ <= HTTP_MAX_HEADER_SIZE)
+        return HTTP_PARSE_AGAIN;
+    error_status_ = 431;
+    return HTTP_PARSE_ERROR;
+}
+
+HttpParseResult HttpParser::parse(char* buf, size_t len){
+    while(true){
+        switch (state_)
+        {
+        case STATE_PARSE_URI:{
+            URIState s = parse_request_line(buf, len);
+            if(s == PARSE_URI_ERROR)
+                return HTTP_PARSE_ERROR;
+            if(s == PARSE_URI_AGAIN)
+                return header_too_large();
+            state_ = STATE_PARSE_HEADERS;
+            break;
+        }
+        case STATE_PARSE_HEADERS:{
+            HeaderState s = parse_headers(buf, len);
+            if(s == PARSE_HEADER_ERROR)
+                return HTTP_PARSE_ERROR;
+            if(s == PARSE_HEADER_AGAIN)
+                return header_too_large();
+            // 请求体长度只由 Content-Length 决定, 不支持 chunked
+            bind_headers(buf);
+            if(req_.has_header("Transfer-Encoding"))
+                return HTTP_PARSE_ERROR;
+            const http_field* cl = req_.find_header("Content-Length");
+            if(cl){
+                std::string_view v = cl->value;
+                if(v.empty() || v.size() > 10)
+                    return HTTP_PARSE_ERROR;
+                for(char c : v){
+                    if(c < '0' || c > '9')
+                        return HTTP_PARSE_ERROR;
+                    content_length_ = content_length_ * 10 + (c - '0');
+                }
+                if(content_length_ > HTTP_MAX_BODY_SIZE){
+                    error_status_ = 413;
+                    return HTTP_PARSE_ERROR;
+                }
+            }
+            body_begin_ = pos_;
+            state_ = STATE_RECV_BODY;
+            break;
+        }
+        case STATE_RECV_BODY:
+            // 请求体不需要逐字节扫描, 只等待足够的长度
+            if(len - body_begin_ < content_length_)
+                return HTTP_PARSE_AGAIN;
+            pos_ = body_begin_ + content_length_;
+            state_ = STATE_ANALYSIS;
+            break;
+        case STATE_ANALYSIS:
+            if(analyze(buf) == ANALYSIS_ERROR)
+                return HTTP_PARSE_ERROR;
+            state_ = STATE_FINISH;
+            break;
+        case STATE_FINISH:
+            return HTTP_PARSE_DONE;
+        }
+    }
+}
+
+// 请求行: METHOD SP URL SP VERSION CRLF
+URIState HttpParser::parse_request_line(const char* buf, size_t len){
+    for(; pos_ < len; ++pos_){
+        // URL 和版本中间的字节不需要逐个进入状态机
+        if(rl_state_ == RL_URL || rl_state_ == RL_VERSION){
+            pos_ = scanner_->url(buf + pos_, buf + len) - buf;
+            if(pos_ == len)
+                break;
+        }
+        char c = buf[pos_];
+        switch (rl_state_)
+        {
+        case RL_METHOD:
+            if(c == ' '){
+                if(pos_ == mark_)
+                    return PARSE_URI_ERROR;
+                req_.method_ = to_method(buf + mark_, pos_ - mark_);
+                rl_state_ = RL_URL;
+                mark_ = pos_ + 1;
+            }
+            else if((c == '\r' || c == '\n') && pos_ == mark_){
+                // 忽略请求之前多余的空行
+                mark_ = pos_ + 1;
+            }
+            else if(c < 'A' || c > 'Z')
+                return PARSE_URI_ERROR;
+            break;
+        case RL_URL:
+            if(c == ' '){
+                if(pos_ == mark_)
+                    return PARSE_URI_ERROR;
+                url_begin_ = mark_;
+                url_len_ = pos_ - mark_;
+                rl_state_ = RL_VERSION;
+                mark_ = pos_ + 1;
+            }
+            else
+                return PARSE_URI_ERROR;
+            break;
+        case RL_VERSION:
+            if(c == '\r' || c == '\n'){
+                req_.version_ = to_version(buf + mark_, pos_ - mark_);
+                if(req_.version_ == HttpVersion::UNKNOW)
+                    return PARSE_URI_ERROR;
+                if(c == '\n'){
+                    ++pos_;
+                    return PARSE_URI_SUCCESS;
+                }
+                rl_state_ = RL_LF;
+            }
+            else
+                return PARSE_URI_ERROR;
+            break;
+        case RL_LF:
+            if(c != '\n')
+                return PARSE_URI_ERROR;
+            ++pos_;
+            return PARSE_URI_SUCCESS;
+        }
+    }
+    return PARSE_URI_AGAIN;
+}
+
+// 头部: (KEY ":" *SP VALUE CRLF)* CRLF, 也接受只有 LF 的换行
+HeaderState HttpParser::parse_headers(const char* buf, size_t len){
+    for(; pos_ < len; ++pos_){
+        // 头部名和值的内容由 scanner 批量跳过, 停下的位置是分隔符或非法字节
+        if(h_state_ == H_KEY){
+            pos_ = scanner_->key(buf + pos_, buf + len) - buf;
+            if(pos_ == len)
+                break;
+        }
+        else if(h_state_ == H_VALUE){
+            pos_ = scanner_->value(buf + pos_, buf + len) - buf;
+            if(pos_ == len)
+                break;
+        }
+        char c = buf[pos_];
+        switch (h_state_)
+        {
+        case H_START:
+        case H_LF:
+            if(c == '\r')
+                h_state_ = H_END_CR;
+            else if(c == '\n'){
+                h_state_ = H_END_LF;
+                ++pos_;
+                return PARSE_HEADER_SUCCESS;
+            }
+            else if(c == ':' || (unsigned char)c <= ' ' || c == 0x7f)
+                return PARSE_HEADER_ERROR;
+            else{
+                key_begin_ = pos_;
+                h_state_ = H_KEY;
+            }
+            break;
+        case H_KEY:
+            if(c == ':'){
+                key_end_ = pos_;
+                h_state_ = H_COLON;
+            }
+            else
+                return PARSE_HEADER_ERROR;
+            break;
+        case H_COLON:
+        case H_SPACES_AFTER_COLON:
+            if(c == ' ' || c == '\t'){
+                h_state_ = H_SPACES_AFTER_COLON;
+                break;
+            }
+            value_begin_ = pos_;
+            h_state_ = H_VALUE;
+            // c 是值的第一个字符, 也可能是空值后的换行
+            [[fallthrough]];
+        case H_VALUE:
+            if(c == '\r'){
+                value_end_ = pos_;
+                h_state_ = H_CR;
+            }
+            else if(c == '\n'){
+                value_end_ = pos_;
+                if(!add_header(buf))
+                    return PARSE_HEADER_ERROR;
+                h_state_ = H_LF;
+            }
+            else if(((unsigned char)c < ' ' && c != '\t') || c == 0x7f)
+                return PARSE_HEADER_ERROR;
+            break;
+        case H_CR:
+            if(c != '\n' || !add_header(buf))
+                return PARSE_HEADER_ERROR;
+            h_state_ = H_LF;
+            break;
+        case H_END_CR:
+            if(c != '\n')
+                return PARSE_HEADER_ERROR;
+            h_state_ = H_END_LF;
+            ++pos_;
+            return PARSE_HEADER_SUCCESS;
+        case H_END_LF:
+            return PARSE_HEADER_SUCCESS;
+        }
+    }
+    return PARSE_HEADER_AGAIN;
+}
+
+// 头部太多时返回 false
+bool HttpParser::add_header(const char* buf){
+    if(span_count_ == HTTP_MAX_HEADERS)
+        return false;
+    size_t end = value_end_;
+    while(end > value_begin_ && (buf[end - 1] == ' ' || buf[end - 1] == '\t'))
+        --end;
+    header_span& s = spans_[span_count_++];
+    s.key_begin = key_begin_;
+    s.key_len = key_end_ - key_begin_;
+    s.value_begin = value_begin_;
+    s.value_len = end - value_begin_;
+    return true;
+}
+
+// 缓冲区可能在两次 parse 之间重新分配, 每次用到时按当前的 buf 重新生成 string_view
+void HttpParser::bind_headers(const char* buf){
+    for(size_t i = 0; i < span_count_; ++i){
+        const header_span& s = spans_[i];
+        req_.headers_[i].key = std::string_view(buf + s.key_begin, s.key_len);
+        req_.headers_[i].value = std::string_view(buf + s.value_begin, s.value_len);
+    }
+    req_.header_count_ = span_count_;
+}
+
+AnalysisState HttpParser::analyze(char* buf){
+    bind_headers(buf);
+    parse_url(req_, buf + url_begin_, url_len_);
+    req_.body = std::string_view(buf + body_begin_, content_length_);
+    req_.keep_alive_ = is_persistent(req_);
+    return ANALYSIS_SUCCESS;
+}
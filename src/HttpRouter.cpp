@@ -0,0 +1,161 @@
+#include "../include/HttpRouter.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+HttpRouter::HttpRouter(std::initializer_list<http_route> routes){
+    for(const http_route& r : routes){
+        if(!add(r.method, r.pattern, r.handler))
+            exit(EXIT_FAILURE);
+    }
+}
+
+// 沿静态前缀 s 向下插入, 必要时拆分已有节点, 返回 s 结束处的节点
+HttpRouter::node* HttpRouter::insert_static(node* n, std::string_view s){
+    while(!s.empty()){
+        size_t i = n->indices.find(s[0]);
+        if(i == std::string::npos){
+            std::unique_ptr<node> child(new node());
+            child->path = std::string(s);
+            n->indices.push_back(s[0]);
+            n->children.push_back(std::move(child));
+            return n->children.back().get();
+        }
+        node* c = n->children[i].get();
+        size_t common = 0;
+        while(common < c->path.size() && common < s.size() && c->path[common] == s[common])
+            ++common;
+        if(common < c->path.size()){
+            // 公共前缀比子节点短, 拆成 公共前缀 -> 原节点剩余部分
+            std::unique_ptr<node> mid(new node());
+            mid->path = c->path.substr(0, common);
+            c->path.erase(0, common);
+            mid->indices.push_back(c->path[0]);
+            mid->children.push_back(std::move(n->children[i]));
+            n->children[i] = std::move(mid);
+            c = n->children[i].get();
+        }
+        s.remove_prefix(common);
+        n = c;
+    }
+    return n;
+}
+
+bool HttpRouter::add(HttpMethod method, std::string_view pattern, http_handler handler){
+    if(method == HttpMethod::UNKNOWN || pattern.empty() || pattern[0] != '/' || !handler){
+        fprintf(stderr, "[ERROR] invalid route: %.*s\n", (int)pattern.size(), pattern.data());
+        return false;
+    }
+    node* n = &root_;
+    size_t params = 0;
+    size_t i = 0;
+    while(i < pattern.size()){
+        size_t j = pattern.find_first_of(":*", i);
+        n = insert_static(n, pattern.substr(i, j == std::string_view::npos ? std::string_view::npos : j - i));
+        if(j == std::string_view::npos)
+            break;
+
+        size_t end = pattern.find('/', j);
+        if(end == std::string_view::npos)
+            end = pattern.size();
+        std::string_view name = pattern.substr(j + 1, end - j - 1);
+        // 参数必须占据整个路径段, 通配只能在末尾
+        if(pattern[j - 1] != '/' || name.empty() || name.find_first_of(":*") != std::string_view::npos
+           || (pattern[j] == '*' && end != pattern.size()) || ++params > HTTP_MAX_ROUTE_PARAMS){
+            fprintf(stderr, "[ERROR] invalid route: %.*s\n", (int)pattern.size(), pattern.data());
+            return false;
+        }
+
+        std::unique_ptr<node>& child = pattern[j] == ':' ? n->param_child : n->wildcard_child;
+        if(!child){
+            child.reset(new node());
+            child->name = std::string(name);
+        }
+        else if(child->name != name){
+            fprintf(stderr, "[ERROR] route %.*s conflicts with parameter '%s'\n",
+                    (int)pattern.size(), pattern.data(), child->name.c_str());
+            return false;
+        }
+        n = child.get();
+        i = end;
+    }
+
+    if(n->handlers[method]){
+        fprintf(stderr, "[ERROR] duplicate route: %s %.*s\n",
+                method_to_string.at(method).c_str(), (int)pattern.size(), pattern.data());
+        return false;
+    }
+    n->handlers[method] = std::move(handler);
+    n->has_handler = true;
+    return true;
+}
+
+// n 的前缀已经匹配, path 为剩余部分; 找不到时撤销本层写入的参数
+const HttpRouter::node* HttpRouter::lookup(const node* n, std::string_view path, HttpRequest& request){
+    if(path.empty()){
+        if(n->has_handler)
+            return n;
+    }
+    else{
+        size_t i = n->indices.find(path[0]);
+        if(i != std::string::npos){
+            const node* c = n->children[i].get();
+            if(path.size() >= c->path.size() && memcmp(path.data(), c->path.data(), c->path.size()) == 0){
+                const node* found = lookup(c, path.substr(c->path.size()), request);
+                if(found)
+                    return found;
+            }
+        }
+        if(n->param_child){
+            size_t end = path.find('/');
+            std::string_view segment = path.substr(0, end);
+            if(!segment.empty()){
+                size_t saved = request.route_param_count_;
+                request.route_params_[request.route_param_count_++] = http_field{n->param_child->name, segment};
+                const node* found = lookup(n->param_child.get(), path.substr(segment.size()), request);
+                if(found)
+                    return found;
+                request.route_param_count_ = saved;
+            }
+        }
+    }
+    if(n->wildcard_child){
+        request.route_params_[request.route_param_count_++] = http_field{n->wildcard_child->name, path};
+        return n->wildcard_child.get();
+    }
+    return nullptr;
+}
+
+void HttpRouter::route(HttpRequest& request, HttpResponse& response, void* ptr) const{
+    request.route_param_count_ = 0;
+    const node* n = lookup(&root_, request.url_, request);
+    if(!n){
+        response.set_statusCode(404);
+        response.set_reasonPhrase("Not Found");
+        response.set_body("Not Found");
+        return;
+    }
+    if(request.method_ != HttpMethod::UNKNOWN && n->handlers[request.method_]){
+        n->handlers[request.method_](request, response, ptr);
+        return;
+    }
+    // 没有单独注册 HEAD 时由 GET 的处理函数生成响应, 发送时去掉响应体
+    if(request.method_ == HttpMethod::HEAD && n->handlers[HttpMethod::GET]){
+        n->handlers[HttpMethod::GET](request, response, ptr);
+        return;
+    }
+
+    std::string allow;
+    for(int m = 0; m < HttpMethod::UNKNOWN; ++m){
+        if(n->handlers[m] || (m == HttpMethod::HEAD && n->handlers[HttpMethod::GET])){
+            if(!allow.empty())
+                allow += ", ";
+            allow += method_to_string.at((HttpMethod)m);
+        }
+    }
+    response.set_statusCode(405);
+    response.set_reasonPhrase("Method Not Allowed");
+    response.set_header("Allow", allow);
+    response.set_body("Method Not Allowed");
+}
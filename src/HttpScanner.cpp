@@ -0,0 +1,137 @@
+#include "../include/HttpScanner.hpp"
+
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/******************************************************************* */
+// scalar
+// 每个字节属于哪些集合, 按位对应 url / key / value
+enum { STOP_URL = 1, STOP_KEY = 2, STOP_VALUE = 4 };
+
+struct stop_table{
+    uint8_t t[256];
+    constexpr stop_table() : t(){
+        for(int c = 0; c < 256; ++c){
+            bool ctl = c < 0x20 || c == 0x7f;
+            t[c] = 0;
+            if(ctl || c == ' ')
+                t[c] |= STOP_URL | STOP_KEY;
+            if(c == ':')
+                t[c] |= STOP_KEY;
+            if(ctl && c != '\t')
+                t[c] |= STOP_VALUE;
+        }
+    }
+};
+
+static constexpr stop_table stop_bytes;
+
+template <int MASK>
+static const char* scan_scalar(const char* p, const char* end){
+    while(p < end && !(stop_bytes.t[(uint8_t)*p] & MASK))
+        ++p;
+    return p;
+}
+
+#ifdef HAVE_X86_SIMD
+/******************************************************************* */
+// SSE4.2: PCMPESTRI 的范围模式, 范围成对给出, 返回第一个落在任一范围内的字节
+static const char URL_RANGES[16] __attribute__((aligned(16))) = "\x00\x20\x7f\x7f";
+static const char KEY_RANGES[16] __attribute__((aligned(16))) = "\x00\x20::\x7f\x7f";
+static const char VALUE_RANGES[16] __attribute__((aligned(16))) = "\x00\x08\x0a\x1f\x7f\x7f";
+
+template <int NRANGES, int MASK>
+__attribute__((target("sse4.2")))
+static const char* scan_sse42(const char* p, const char* end, const char* ranges){
+    const __m128i r = _mm_load_si128((const __m128i*)ranges);
+    while(end - p >= 16){
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        int idx = _mm_cmpestri(r, NRANGES, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if(idx != 16)
+            return p + idx;
+        p += 16;
+    }
+    return scan_scalar<MASK>(p, end);
+}
+
+static const char* url_sse42(const char* p, const char* end){ return scan_sse42<4, STOP_URL>(p, end, URL_RANGES); }
+static const char* key_sse42(const char* p, const char* end){ return scan_sse42<6, STOP_KEY>(p, end, KEY_RANGES); }
+static const char* value_sse42(const char* p, const char* end){ return scan_sse42<6, STOP_VALUE>(p, end, VALUE_RANGES); }
+
+/******************************************************************* */
+// AVX2: 没有范围比较指令, 用无符号 min 判断 <= 0x1f/0x20, 再并上单个字节的比较
+__attribute__((target("avx2")))
+static inline __m256i le_u8(__m256i v, char bound){
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(bound)), v);
+}
+
+template <int MASK>
+__attribute__((target("avx2")))
+static const char* scan_avx2(const char* p, const char* end){
+    while(end - p >= 32){
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i hit = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f));
+        if(MASK == STOP_VALUE){
+            // 控制字符中只有 '\t' 允许出现在值里
+            __m256i ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')), le_u8(v, 0x1f));
+            hit = _mm256_or_si256(hit, ctl);
+        }
+        else{
+            hit = _mm256_or_si256(hit, le_u8(v, 0x20));
+            if(MASK == STOP_KEY)
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')));
+        }
+        uint32_t bits = (uint32_t)_mm256_movemask_epi8(hit);
+        if(bits)
+            return p + __builtin_ctz(bits);
+        p += 32;
+    }
+    return scan_scalar<MASK>(p, end);
+}
+
+static const char* url_avx2(const char* p, const char* end){ return scan_avx2<STOP_URL>(p, end); }
+static const char* key_avx2(const char* p, const char* end){ return scan_avx2<STOP_KEY>(p, end); }
+static const char* value_avx2(const char* p, const char* end){ return scan_avx2<STOP_VALUE>(p, end); }
+#endif
+
+/******************************************************************* */
+// dispatch
+static const http_scanner scalar_scanner = {"scalar", scan_scalar<STOP_URL>, scan_scalar<STOP_KEY>, scan_scalar<STOP_VALUE>};
+#ifdef HAVE_X86_SIMD
+static const http_scanner sse42_scanner = {"sse4.2", url_sse42, key_sse42, value_sse42};
+static const http_scanner avx2_scanner = {"avx2", url_avx2, key_avx2, value_avx2};
+#endif
+
+const http_scanner* get_http_scanner(scanner_impl impl){
+#ifdef HAVE_X86_SIMD
+    // 可能在其他静态对象的构造中被调用, 此时 CPU 特性还没有初始化
+    __builtin_cpu_init();
+#endif
+    switch (impl)
+    {
+    case SCANNER_SCALAR:
+        return &scalar_scanner;
+#ifdef HAVE_X86_SIMD
+    case SCANNER_SSE42:
+        return __builtin_cpu_supports("sse4.2") ? &sse42_scanner : nullptr;
+    case SCANNER_AVX2:
+        return __builtin_cpu_supports("avx2") ? &avx2_scanner : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+const http_scanner* default_http_scanner(){
+    static const http_scanner* best = []{
+        const http_scanner* s = get_http_scanner(SCANNER_AVX2);
+        if(!s)
+            s = get_http_scanner(SCANNER_SSE42);
+        return s ? s : &scalar_scanner;
+    }();
+    return best;
+}
@@ -1,85 +1,161 @@
 #include "../include/HttpServer_util.hpp"
 
-std::unordered_map<std::string, std::function<void(const HttpRequest&, HttpResponse&, void*)>> http_router = {
-    {"/", handle_root},
-    {"/favicon.ico", handle_root},
-    {"/login", handle_login},
-    {"/dashboard", handle_dashboard},
-    {"/upgrade", handle_upgrade}
+const HttpRouter http_router = {
+    {HttpMethod::GET, "/", handle_root},
+    {HttpMethod::GET, "/favicon.ico", handle_root},
+    {HttpMethod::POST, "/login", handle_login},
+    {HttpMethod::GET, "/dashboard", handle_dashboard},
+    // 媒体文件 (mp4/mp3/pdf/zip 等) 放在 media/ 下, 与页面一样由 sendfile 发送
+    {HttpMethod::GET, "/media/*path", handle_root},
+    {HttpMethod::GET, "/upgrade", handle_upgrade}
 };
 
-std::string read_http_request(int fd){
-    std::string request;
-    char buffer[4096];
+// 读到 EAGAIN 或 buf 达到 limit 为止, 追加到 buf 末尾; 返回读到的字节数, 对端关闭或出错时返回 -1
+// 达到 limit 时套接字中可能还有数据, 由调用者处理完缓冲区后再读
+ssize_t read_http_request(int fd, std::string& buf, size_t limit){
+    // 流水线压测时一次可能收到上百个请求, 用大一些的缓冲区减少 recv 次数
+    char buffer[HTTP_READ_CHUNK];
+    ssize_t total = 0;
 
-    while (true) {
-        int bytes = recv(fd, buffer, sizeof(buffer) - 1, 0);
+    while (buf.size() < limit) {
+        size_t want = limit - buf.size() < sizeof(buffer) ? limit - buf.size() : sizeof(buffer);
+        ssize_t bytes = recv(fd, buffer, want, 0);
         if (bytes > 0) {
-            buffer[bytes] = '\0';
-            request.append(buffer, bytes);
+            buf.append(buffer, bytes);
+            total += bytes;
         } else if (bytes == 0) {
             //std::cout << "[INFO] Client closed connection: " << fd << std::endl;
-            //close(fd);
-            return "";
+            return -1;
         } else {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 break;  // 所有数据读取完毕
-            } else {
+            } else if (errno != EINTR) {
                 perror("[ERROR] recv failed");
-                //close(fd);
-                return "";
+                return -1;
             }
         }
     }
-    return request;
+    return total;
 }
 
-bool send_http_response(int fd, const std::string &response) {
-    size_t total_sent = 0;
-    size_t response_size = response.size();
-
-    while (total_sent < response_size) {
-        ssize_t bytes_sent = send(fd, response.c_str() + total_sent, response_size - total_sent, 0);
-        if (bytes_sent < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                continue; // 继续发送
-            } else {
-                perror("[ERROR] send failed");
-                //close(fd);
-                return false;
-            }
+// 头部格式化到一段小缓冲区, 响应体的各段原样跟在后面, 内存段由同一次 sendmsg 发出, 文件段由 sendfile 发出
+// head_only: HEAD 请求的响应, 只发送状态行和头部, Content-Length 仍是响应体的长度
+void append_http_response(std::vector<out_chunk>& out, const HttpResponse& response, bool head_only){
+    if(response.prebuilt()){
+        if(!head_only){
+            out.push_back(out_chunk(response.prebuilt()));
+            return;
         }
-        total_sent += bytes_sent;
+        const std::string& prebuilt = *response.prebuilt();
+        size_t end = prebuilt.find("\r\n\r\n");
+        out.push_back(out_chunk(prebuilt.substr(0, end == std::string::npos ? prebuilt.size() : end + 4)));
+        return;
+    }
+    out_chunk head{std::string()};
+    head.data.reserve(256);
+    response.write_head(head.data);
+    out.push_back(std::move(head));
+    if(head_only)
+        return;
+    for(const body_part& part : response.body()){
+        if(part.file)
+            out.push_back(out_chunk(part.file, part.begin, part.end));
+        else
+            out.push_back(out_chunk(part.data));
     }
-    return true;
 }
 
-void http_response(void* ptr, EpollWrapper &ew){
+bool send_http_response(connection* conn, const HttpResponse& response) {
+    // 不再在 EAGAIN 上自旋, 剩余部分交给连接的输出队列, 由 EPOLLOUT 驱动发送
+    std::vector<out_chunk> chunks;
+    append_http_response(chunks, response);
+    return conn->send(std::move(chunks));
+}
 
-    std::string request_ = read_http_request(((connection*)ptr)->fd);
+bool send_http_response(connection* conn, std::vector<out_chunk>&& responses) {
+    if(responses.empty())
+        return true;
+    return conn->send(std::move(responses));
+}
 
-    //std::cout << request_ << std::endl;
+// 解析 in_buf 中所有完整的请求, 响应追加到 responses; 已处理的请求从 in_buf 中丢弃
+// 返回 true 表示处理完后关闭写端; upgraded 为 true 时之后的数据是 WebSocket 帧
+static bool handle_http_requests(connection* conn, std::vector<out_chunk>& responses, bool& upgraded){
+    void* ptr = conn;
+    size_t offset = 0;
+    bool shutdown_wr = false;
+    while(!shutdown_wr && offset < conn->in_buf.size()){
+        // 解析器从上次停下的位置继续, 请求不完整时保留状态等待下一次可读
+        HttpParseResult result = conn->http_parser.parse(&conn->in_buf[offset], conn->in_buf.size() - offset);
+        if(result == HTTP_PARSE_AGAIN)
+            break;
+        if(result == HTTP_PARSE_ERROR){
+            HttpResponse bad_request;
+            int status = conn->http_parser.error_status();
+            bad_request.set_statusCode(status);
+            bad_request.set_reasonPhrase(status == 431 ? "Request Header Fields Too Large" : status == 413 ? "Payload Too Large" : "Bad Request");
+            bad_request.set_header("Connection", "close");
+            append_http_response(responses, bad_request);
+            conn->in_buf.clear();
+            conn->http_parser.reset();
+            return true;
+        }
 
-    if(request_.size() == 0){
-        //shutdown(fd, SHUT_WR);
-        return;
-    }
+        HttpRequest& http_request_ = conn->http_parser.request();
+
+        //std::cout << formatHttpRequest(http_request_) << std::endl;
+
+        // 构造 HTTP 响应
+        HttpResponse http_response_;
 
-    HttpRequest http_request_ = parse_HttpRequest(request_);
+        // 路由表只读, 未知路径返回 404, 不支持的方法返回 405
+        http_router.route(http_request_, http_response_, ptr);
 
-    // 构造 HTTP 响应
-    HttpResponse http_response_;
+        append_http_response(responses, http_response_, http_request_.method_ == HttpMethod::HEAD);
 
-    http_router[http_request_.url_](http_request_, http_response_, ptr);
+        // 只有处理函数真正完成了升级才切换协议, 带 Upgrade 头但被拒绝的请求按普通请求继续
+        upgraded = conn->conn_type == WEBSOCKET;
+        shutdown_wr = !http_request_.keep_alive_ && !upgraded;
 
-    // Send HTTP response
-    send_http_response(((connection*)ptr)->fd, http_response_.HttpResponse_to_string());
+        offset += conn->http_parser.consumed();
+        conn->http_parser.reset();
+        // 之后的数据是 WebSocket 帧, 留在 in_buf 中, 由 serve_connection 交给 websocket_response
+        if(upgraded)
+            break;
+    }
+    if(offset > 0)
+        conn->in_buf.erase(0, offset);
+    return shutdown_wr;
+}
 
-    ew.mod_fd(ptr, ((connection*)ptr)->fd, EPOLLONESHOT | EPOLLIN | EPOLLERR | EPOLLRDHUP | EPOLLHUP | EPOLLET);
-    if(!http_request_.keep_alive_ && http_request_.headers_.find("Upgrade") == http_request_.headers_.end()){
-        //std::cout << "response shutdown" << std::endl;
-        shutdown(((connection*)ptr)->fd, SHUT_WR);
+bool http_response(connection* conn){
+    // 对端关闭时已经收到的完整请求仍然处理, 之后关闭写端
+    // 流水线: 按顺序处理缓冲区中所有完整的请求, 每一轮的响应攒在一起, 一次 sendmsg 发出
+    // 每轮最多读到当前请求还可能用到的长度再加一次 recv, 缓冲区不会超过头部上限加声明的请求体长度
+    bool shutdown_wr = false;
+    bool upgraded = false;
+    while(true){
+        // in_buf 中只剩当前请求不完整的部分, 不会超过 wanted()
+        size_t limit = conn->http_parser.wanted() + HTTP_READ_CHUNK;
+        bool eof = read_http_request(conn->fd, conn->in_buf, limit) < 0;
+        // 因为达到上限而停止时套接字中可能还有数据, 处理完这一轮再继续读
+        bool more = conn->in_buf.size() >= limit;
+
+        size_t buffered = conn->in_buf.size();
+        std::vector<out_chunk> responses;
+        shutdown_wr = handle_http_requests(conn, responses, upgraded) || eof;
+        send_http_response(conn, std::move(responses));
+        // header 超时从不完整请求的第一个字节算起: 处理完请求后剩下的是新请求的开头, 重新计时
+        if(conn->in_buf.empty())
+            conn->request_start = 0;
+        else if(conn->request_start == 0 || conn->in_buf.size() < buffered)
+            conn->request_start = TimingWheel::now_ms();
+        if(shutdown_wr || upgraded || !more)
+            break;
     }
+
+    //std::cout << "response shutdown" << std::endl;
+    return shutdown_wr;
 }
 
 void handle_root(const HttpRequest& request, HttpResponse& response, void* ptr){
@@ -92,9 +168,8 @@ void handle_login(const HttpRequest& request, HttpResponse& response, void* ptr)
 }
 
 void handle_dashboard(const HttpRequest& request, HttpResponse& response, void* ptr){
-    auto iter = request.headers_.find("Cookie");
-    if(iter == request.headers_.end() || get_cookie_value(iter->second, "session_id") != "12345"){
-        std::cout << "cookie!!!" << std::endl;
+    const http_field* cookie = request.find_header("Cookie");
+    if(!cookie || get_cookie_value(cookie->value, "session_id") != "12345"){
         response.set_statusCode(403);
         response.set_body("Forbidden: no cookie found");
     }
@@ -104,19 +179,31 @@ void handle_dashboard(const HttpRequest& request, HttpResponse& response, void*
 }
 
 void handle_upgrade(const HttpRequest& request, HttpResponse& response, void* ptr){
-    ((connection*)ptr)->conn_type = WEBSOCKET;
+    std::string_view user = request.query("user");
+    if(user.empty()){
+        response.set_statusCode(400);
+        response.set_reasonPhrase("Bad Request");
+        response.set_body("missing user");
+        return;
+    }
     response = make_upgrade_response(request);
-    user_to_connection[request.query_params_.at("user")] = connections[((connection*)ptr)->fd];
-    fd_to_user[((connection*)ptr)->fd] = request.query_params_.at("user");
+    register_user((connection*)ptr, std::string(user), WEBSOCKET);
 }
 
 
 
 
-std::string get_cookie_value(const std::string& cookie_header, const std::string& key) {
-    size_t pos = cookie_header.find(key + "=");
-    if (pos == std::string::npos) return "";
-    pos += key.length() + 1;
-    size_t end = cookie_header.find(";", pos);
-    return cookie_header.substr(pos, end - pos);
+std::string_view get_cookie_value(std::string_view cookie_header, std::string_view key) {
+    size_t pos = 0;
+    while ((pos = cookie_header.find(key, pos)) != std::string_view::npos) {
+        // 只匹配完整的 cookie 名
+        bool at_start = pos == 0 || cookie_header[pos - 1] == ' ' || cookie_header[pos - 1] == ';';
+        size_t eq = pos + key.length();
+        if (at_start && eq < cookie_header.size() && cookie_header[eq] == '=') {
+            size_t end = cookie_header.find(';', eq + 1);
+            return cookie_header.substr(eq + 1, end == std::string_view::npos ? std::string_view::npos : end - eq - 1);
+        }
+        pos = eq;
+    }
+    return std::string_view();
 }
\ No newline at end of file
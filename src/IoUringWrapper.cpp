@@ -0,0 +1,382 @@
+#include "../include/IoUringWrapper.hpp"
+
+#ifdef HAVE_IO_URING
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace{
+
+const int MAXEVENTS = 4096;
+
+// user_data 高 8 位区分请求类型, POLL 请求低 32 位为 fd, 中间 24 位为代数(防止旧的完成事件误用)
+enum : uint64_t{
+    UD_POLL = 1,
+    UD_REMOVE = 2,
+    UD_ACCEPT = 3
+};
+
+inline uint64_t make_ud(uint64_t kind, uint32_t gen, uint32_t idx){
+    return (kind << 56) | ((uint64_t)(gen & 0xffffff) << 32) | idx;
+}
+
+}
+
+IoUringWrapper::IoUringWrapper(unsigned entries)
+    : ring_fd_(-1), ring_ptr_(MAP_FAILED), ring_len_(0), sqes_(nullptr), sqes_len_(0), sq_tail_(0), sq_entries_(0),
+      accept_ok_(false), multishot_ok_(false), owner_(), waiting_(false), events_(MAXEVENTS){
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 4;
+    int fd = syscall(__NR_io_uring_setup, entries, &p);
+    if(fd < 0)
+        return;
+
+    // EXT_ARG 用于带超时的等待, NODROP 保证完成事件不会丢失
+    const unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if((p.features & required) != required){
+        close(fd);
+        return;
+    }
+
+    size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    ring_len_ = sq_len > cq_len ? sq_len : cq_len;
+    ring_ptr_ = mmap(nullptr, ring_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(ring_ptr_ == MAP_FAILED){
+        close(fd);
+        return;
+    }
+    sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED){
+        munmap(ring_ptr_, ring_len_);
+        ring_ptr_ = MAP_FAILED;
+        close(fd);
+        return;
+    }
+    sqes_ = (io_uring_sqe*)sqes;
+
+    char* base = (char*)ring_ptr_;
+    sq_khead_ = (unsigned*)(base + p.sq_off.head);
+    sq_ktail_ = (unsigned*)(base + p.sq_off.tail);
+    sq_kmask_ = (unsigned*)(base + p.sq_off.ring_mask);
+    sq_array_ = (unsigned*)(base + p.sq_off.array);
+    sq_entries_ = p.sq_entries;
+    sq_tail_ = *sq_ktail_;
+    cq_khead_ = (unsigned*)(base + p.cq_off.head);
+    cq_ktail_ = (unsigned*)(base + p.cq_off.tail);
+    cq_kmask_ = (unsigned*)(base + p.cq_off.ring_mask);
+    cqes_ = (io_uring_cqe*)(base + p.cq_off.cqes);
+    ring_fd_ = fd;
+
+    // multishot accept 无法单独探测, 先假定可用, 第一次完成返回 EINVAL 时退回单次 accept
+    accept_ok_ = probe_accept();
+    multishot_ok_ = accept_ok_;
+}
+
+IoUringWrapper::~IoUringWrapper(){
+    if(ring_fd_ < 0)
+        return;
+    close(ring_fd_);
+    munmap(sqes_, sqes_len_);
+    munmap(ring_ptr_, ring_len_);
+    // 已经 accept 但还没被取走的连接
+    for(auto& a : accepts_)
+        for(int fd : a.ready)
+            close(fd);
+}
+
+// IORING_REGISTER_PROBE 需要 5.6, 探测失败时当作不支持, 由调用者 accept4
+bool IoUringWrapper::probe_accept(){
+    const size_t len = sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op);
+    io_uring_probe* probe = (io_uring_probe*)calloc(1, len);
+    if(!probe)
+        return false;
+    bool ok = false;
+    if(syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) >= 0)
+        ok = probe->last_op >= IORING_OP_ACCEPT && (probe->ops[IORING_OP_ACCEPT].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+// 以下 SQ 操作都要求持有 mtx_
+io_uring_sqe* IoUringWrapper::get_sqe(){
+    unsigned head = __atomic_load_n(sq_khead_, __ATOMIC_ACQUIRE);
+    if(sq_tail_ - head >= sq_entries_){
+        // 提交队列已满, 先交给内核
+        publish();
+        enter(sq_tail_ - head, 0, 0, nullptr, 0);
+        head = __atomic_load_n(sq_khead_, __ATOMIC_ACQUIRE);
+        if(sq_tail_ - head >= sq_entries_)
+            return nullptr;
+    }
+    unsigned idx = sq_tail_ & *sq_kmask_;
+    io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[idx] = idx;
+    ++sq_tail_;
+    return sqe;
+}
+
+// SQE 填好之后才更新内核可见的 tail, 其他线程并发 io_uring_enter 时不会取到半成品
+void IoUringWrapper::publish(){
+    __atomic_store_n(sq_ktail_, sq_tail_, __ATOMIC_RELEASE);
+}
+
+unsigned IoUringWrapper::pending(){
+    return sq_tail_ - __atomic_load_n(sq_khead_, __ATOMIC_ACQUIRE);
+}
+
+int IoUringWrapper::enter(unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t argsz){
+    return syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, arg, argsz);
+}
+
+void IoUringWrapper::submit_if_foreign(){
+    if(std::this_thread::get_id() == owner_.load(std::memory_order_relaxed))
+        return;
+    unsigned n;
+    {
+        std::lock_guard<std::mutex> lg(mtx_);
+        // reactor 没有在等待时, 它的下一次 wait() 会把这次注册一起提交, 不必单独进入内核
+        // waiting_ 和提交队列在同一把锁下读写: reactor 在这之后计算 to_submit 时一定能看到这次注册
+        if(!waiting_)
+            return;
+        n = pending();
+    }
+    if(n > 0)
+        enter(n, 0, 0, nullptr, 0);
+}
+
+void IoUringWrapper::queue_poll_add(int fd, poll_entry& e){
+    io_uring_sqe* sqe = get_sqe();
+    if(!sqe)
+        return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    // 不带 EPOLLONESHOT 的注册使用 multishot poll, EPOLLET/EPOLLEXCLUSIVE 由内核直接识别
+    sqe->poll32_events = e.events & ~EPOLLONESHOT;
+    sqe->len = (e.events & EPOLLONESHOT) ? 0 : IORING_POLL_ADD_MULTI;
+    sqe->user_data = make_ud(UD_POLL, e.gen, fd);
+    e.armed = true;
+}
+
+void IoUringWrapper::queue_poll_remove(const poll_entry& e, int fd){
+    io_uring_sqe* sqe = get_sqe();
+    if(!sqe)
+        return;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = make_ud(UD_POLL, e.gen, fd);
+    sqe->user_data = make_ud(UD_REMOVE, 0, 0);
+}
+
+void IoUringWrapper::queue_accept(size_t idx){
+    io_uring_sqe* sqe = get_sqe();
+    if(!sqe)
+        return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = accepts_[idx].fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = multishot_ok_ ? IORING_ACCEPT_MULTISHOT : 0;
+    sqe->user_data = make_ud(UD_ACCEPT, 0, idx);
+}
+
+bool IoUringWrapper::arm(uint64_t data, int fd, uint32_t events, bool is_mod){
+    if(fd < 0)
+        return false;
+    {
+        std::lock_guard<std::mutex> lg(mtx_);
+        if((size_t)fd >= polls_.size())
+            polls_.resize(fd + 1, poll_entry{});
+        poll_entry& e = polls_[fd];
+        // 与 epoll_ctl 一致: ADD 已存在的 fd 或 MOD 不存在的 fd 都失败
+        if(e.in_use != is_mod)
+            return false;
+        if(e.armed)
+            queue_poll_remove(e, fd);
+        e.gen++;
+        e.data = data;
+        e.events = events;
+        e.in_use = true;
+        queue_poll_add(fd, e);
+        publish();
+    }
+    submit_if_foreign();
+    return true;
+}
+
+bool IoUringWrapper::add_fd(int fd, uint32_t events){
+    return arm((uint32_t)fd, fd, events, false);
+}
+
+bool IoUringWrapper::add_fd(uint64_t data, int fd, uint32_t events){
+    return arm(data, fd, events, false);
+}
+
+bool IoUringWrapper::mod_fd(int fd, uint32_t events){
+    return arm((uint32_t)fd, fd, events, true);
+}
+
+bool IoUringWrapper::mod_fd(uint64_t data, int fd, uint32_t events){
+    return arm(data, fd, events, true);
+}
+
+bool IoUringWrapper::del_fd(int fd){
+    {
+        std::lock_guard<std::mutex> lg(mtx_);
+        if(fd < 0 || (size_t)fd >= polls_.size() || !polls_[fd].in_use)
+            return false;
+        poll_entry& e = polls_[fd];
+        if(e.armed)
+            queue_poll_remove(e, fd);
+        e.gen++;
+        e.in_use = false;
+        e.armed = false;
+        publish();
+    }
+    submit_if_foreign();
+    return true;
+}
+
+bool IoUringWrapper::accept_multishot(int listen_fd, uint64_t data){
+    if(!accept_ok_)
+        return false;
+    {
+        std::lock_guard<std::mutex> lg(mtx_);
+        accepts_.push_back(accept_entry{listen_fd, data, {}});
+        queue_accept(accepts_.size() - 1);
+        publish();
+    }
+    submit_if_foreign();
+    return true;
+}
+
+int IoUringWrapper::take_accepted(uint64_t data, int* fds, int max){
+    std::lock_guard<std::mutex> lg(mtx_);
+    for(auto& a : accepts_){
+        if(a.data != data)
+            continue;
+        int n = 0;
+        while(n < max && n < (int)a.ready.size()){
+            fds[n] = a.ready[n];
+            ++n;
+        }
+        a.ready.erase(a.ready.begin(), a.ready.begin() + n);
+        return n;
+    }
+    return 0;
+}
+
+// 持有 mtx_ 时调用
+void IoUringWrapper::handle_cqe(const io_uring_cqe& cqe, int& n){
+    uint64_t kind = cqe.user_data >> 56;
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+
+    if(kind == UD_POLL){
+        uint32_t fd = (uint32_t)cqe.user_data;
+        uint32_t gen = (cqe.user_data >> 32) & 0xffffff;
+        if(fd >= polls_.size())
+            return;
+        poll_entry& e = polls_[fd];
+        // 已经被 mod/del 取代的注册
+        if(!e.in_use || (e.gen & 0xffffff) != gen)
+            return;
+        if(!more)
+            e.armed = false;
+        if(cqe.res == -ECANCELED)
+            return;
+        // multishot poll 被内核终止, 重新注册以保持持久注册的语义
+        if(!more && !(e.events & EPOLLONESHOT))
+            queue_poll_add(fd, e);
+        epoll_event& ev = events_[n++];
+        ev.events = cqe.res < 0 ? EPOLLERR : (uint32_t)cqe.res;
+        ev.data.u64 = e.data;
+    }
+    else if(kind == UD_ACCEPT){
+        accept_entry& a = accepts_[(uint32_t)cqe.user_data];
+        // 不支持 IORING_ACCEPT_MULTISHOT 的内核 (5.5 ~ 5.18) 返回 EINVAL, 改为单次 accept 重新提交
+        if(cqe.res == -EINVAL && multishot_ok_){
+            multishot_ok_ = false;
+            fprintf(stderr, "[INFO] io_uring multishot accept unsupported, using single-shot accept\n");
+            queue_accept((uint32_t)cqe.user_data);
+            return;
+        }
+        if(!more)
+            queue_accept((uint32_t)cqe.user_data);
+        if(cqe.res < 0){
+            if(cqe.res != -ECANCELED)
+                fprintf(stderr, "[ERROR] io_uring accept failed: %s\n", strerror(-cqe.res));
+            return;
+        }
+        a.ready.push_back(cqe.res);
+        // 队列由空变为非空时通知一次, 之后由调用者通过 take_accepted 取完
+        if(a.ready.size() == 1){
+            epoll_event& ev = events_[n++];
+            ev.events = EPOLLIN;
+            ev.data.u64 = a.data;
+        }
+    }
+}
+
+void IoUringWrapper::reap(int& n){
+    std::lock_guard<std::mutex> lg(mtx_);
+    waiting_ = false;
+    unsigned head = *cq_khead_;
+    unsigned tail = __atomic_load_n(cq_ktail_, __ATOMIC_ACQUIRE);
+    while(head != tail && n < MAXEVENTS){
+        handle_cqe(cqes_[head & *cq_kmask_], n);
+        ++head;
+    }
+    __atomic_store_n(cq_khead_, head, __ATOMIC_RELEASE);
+    // 处理完成事件时可能重新注册了 poll/accept
+    publish();
+}
+
+int IoUringWrapper::wait(int timeout){
+    owner_.store(std::this_thread::get_id(), std::memory_order_relaxed);
+
+    unsigned to_submit;
+    bool ready;
+    {
+        std::lock_guard<std::mutex> lg(mtx_);
+        to_submit = pending();
+        ready = *cq_khead_ != __atomic_load_n(cq_ktail_, __ATOMIC_ACQUIRE);
+        // 之后才发布的注册不在 to_submit 中, 会阻塞时由发布它的线程自己提交
+        waiting_ = !ready && timeout != 0;
+    }
+
+    // 提交和等待合并为一次 io_uring_enter, 完成队列中已有事件时不再等待
+    if(to_submit > 0 || !ready){
+        __kernel_timespec ts;
+        io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        if(timeout >= 0){
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+            arg.ts = (uint64_t)&ts;
+        }
+        unsigned min_complete = (ready || timeout == 0) ? 0 : 1;
+        int ret = enter(to_submit, min_complete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        if(ret < 0 && errno != ETIME && errno != EINTR && errno != EBUSY)
+            return -1;
+    }
+
+    int n = 0;
+    reap(n);
+    return n;
+}
+
+mystl::vector<epoll_event>::iterator IoUringWrapper::get_events(){
+    return events_.begin();
+}
+
+#endif
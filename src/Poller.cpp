@@ -0,0 +1,19 @@
+#include "../include/Poller.hpp"
+#include "../include/EpollWrapper.hpp"
+#include "../include/IoUringWrapper.hpp"
+
+#include <iostream>
+
+std::unique_ptr<Poller> make_poller(io_backend backend){
+    if(backend == IO_URING){
+#ifdef HAVE_IO_URING
+        auto uring = std::make_unique<IoUringWrapper>();
+        if(uring->ok())
+            return uring;
+        std::cout << "[INFO] io_uring unavailable, falling back to epoll" << std::endl;
+#else
+        std::cout << "[INFO] built without io_uring support, falling back to epoll" << std::endl;
+#endif
+    }
+    return std::make_unique<EpollWrapper>();
+}
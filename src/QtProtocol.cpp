@@ -0,0 +1,77 @@
+#include "../include/QtProtocol.hpp"
+
+#include <arpa/inet.h>
+#include <string.h>
+
+std::string encode_qt_frame(uint16_t type, uint32_t user_id, const char* payload, size_t len, uint16_t flags){
+    std::string frame(QT_HEADER_SIZE + len, '\0');
+    uint32_t n_len = htonl((uint32_t)len);
+    uint16_t n_type = htons(type);
+    uint16_t n_flags = htons(flags);
+    uint32_t n_user = htonl(user_id);
+    memcpy(&frame[0], &n_len, 4);
+    memcpy(&frame[4], &n_type, 2);
+    memcpy(&frame[6], &n_flags, 2);
+    memcpy(&frame[8], &n_user, 4);
+    if(len)
+        memcpy(&frame[QT_HEADER_SIZE], payload, len);
+    return frame;
+}
+
+std::string encode_qt_frame(uint16_t type, uint32_t user_id, const std::string& payload, uint16_t flags){
+    return encode_qt_frame(type, user_id, payload.data(), payload.size(), flags);
+}
+
+void QtFrameDecoder::feed(const char* data, size_t len){
+    // 已消费的部分超过一半时再整理, 避免每帧都移动剩余数据
+    if(pos_ > 0 && pos_ * 2 >= buf_.size()){
+        buf_.erase(0, pos_);
+        pos_ = 0;
+    }
+    buf_.append(data, len);
+}
+
+bool QtFrameDecoder::next(qt_frame& frame){
+    if(error_ || buf_.size() - pos_ < QT_HEADER_SIZE)
+        return false;
+    const char* p = buf_.data() + pos_;
+    uint32_t len;
+    uint16_t type, flags;
+    uint32_t user_id;
+    memcpy(&len, p, 4);
+    memcpy(&type, p + 4, 2);
+    memcpy(&flags, p + 6, 2);
+    memcpy(&user_id, p + 8, 4);
+    len = ntohl(len);
+    if(len > QT_MAX_PAYLOAD){
+        error_ = true;
+        return false;
+    }
+    if(buf_.size() - pos_ < QT_HEADER_SIZE + len)
+        return false;
+    frame.type = ntohs(type);
+    frame.flags = ntohs(flags);
+    frame.user_id = ntohl(user_id);
+    frame.payload.assign(p + QT_HEADER_SIZE, len);
+    pos_ += QT_HEADER_SIZE + len;
+    if(pos_ == buf_.size()){
+        buf_.clear();
+        pos_ = 0;
+    }
+    return true;
+}
+
+size_t QtFrameDecoder::wanted() const{
+    if(buf_.size() - pos_ < QT_HEADER_SIZE)
+        return QT_HEADER_SIZE;
+    uint32_t len;
+    memcpy(&len, buf_.data() + pos_, 4);
+    len = ntohl(len);
+    return len > QT_MAX_PAYLOAD ? QT_HEADER_SIZE : QT_HEADER_SIZE + len;
+}
+
+void QtFrameDecoder::reset(){
+    buf_.clear();
+    pos_ = 0;
+    error_ = false;
+}
@@ -0,0 +1,75 @@
+#include "../include/QtServer_util.hpp"
+
+static void send_qt_error(connection* conn, const std::string& msg){
+    conn->send(encode_qt_frame(QT_ERROR, conn->user_id, msg));
+}
+
+// 处理解码器中所有完整的帧, 需要关闭写端时返回 true
+static bool handle_qt_frames(connection* conn){
+    qt_frame frame;
+    while(conn->qt_decoder.next(frame)){
+        switch (frame.type)
+        {
+        case QT_LOGIN:
+            if(frame.payload.empty()){
+                send_qt_error(conn, "empty user name");
+                break;
+            }
+            // 连接已经被 reactor 关闭
+            if(!register_user(conn, frame.payload, QT))
+                return true;
+            conn->send(encode_qt_frame(QT_LOGIN, conn->user_id, frame.payload));
+            break;
+        case QT_CHAT:
+            // 以服务器分配的 user_id 为准, 忽略帧头中客户端填写的值
+            if(!broadcast_chat(conn, frame.payload))
+                send_qt_error(conn, "not logged in");
+            break;
+        case QT_LOGOUT:
+            unregister_user(conn);
+            return true;
+        case QT_PING:
+            conn->send(encode_qt_frame(QT_PONG, conn->user_id, frame.payload, frame.flags));
+            break;
+        default:
+            send_qt_error(conn, "unknown message type " + std::to_string(frame.type));
+            break;
+        }
+    }
+
+    if(conn->qt_decoder.error()){
+        // 帧边界已经丢失, 不再处理这个连接上的数据
+        send_qt_error(conn, "frame too large");
+        return true;
+    }
+    return false;
+}
+
+bool qt_response(connection* conn){
+    char buffer[4096];
+    // 每轮最多缓冲到当前帧的长度再加一次 read, 处理完再继续读, 缓冲区不超过一个最大帧
+    while(true){
+        bool eof = false;
+        bool more = false;
+        while(true){
+            if(conn->qt_decoder.buffered() >= conn->qt_decoder.wanted() + sizeof(buffer)){
+                more = true;
+                break;
+            }
+            ssize_t n = read(conn->fd, buffer, sizeof(buffer));
+            if(n > 0){
+                conn->qt_decoder.feed(buffer, n);
+                continue;
+            }
+            if(n < 0 && errno == EINTR)
+                continue;
+            // 对端关闭或出错时处理完已经收到的帧, 之后关闭写端
+            eof = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+            break;
+        }
+        if(handle_qt_frames(conn) || eof)
+            return true;
+        if(!more)
+            return false;
+    }
+}
@@ -1,24 +1,53 @@
 #include "../include/ThreadPool.hpp"
+#include "../include/Affinity.hpp"
 
-ThreadPool::ThreadPool(int n) : nthreads(n), stop_(false), tg_(threads_){
+// 当前线程所属的线程池和工作线程编号, 非工作线程为 nullptr / -1
+static thread_local ThreadPool* current_pool = nullptr;
+static thread_local int current_worker = -1;
+
+// 一次最多从注入队列取走的任务数
+static const size_t INJECT_BATCH = 32;
+// 找不到任务时睡眠之前的重试次数
+static const int SPIN_ROUNDS = 16;
+
+static uint32_t xorshift(uint32_t& s){
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+}
+
+static int default_threads(int n){
+    if(n > 0)
+        return n;
+    unsigned int hc = std::thread::hardware_concurrency();
+    return hc > 0 ? (int)hc : 1;
+}
+
+ThreadPool::ThreadPool(int n, size_t queue_capacity, const std::vector<int>& cpus)
+    : nthreads(default_threads(n)), stop_(false), workers_(new std::unique_ptr<worker>[default_threads(n)]),
+      injected_{MpmcQueue<task_node*>(queue_capacity), MpmcQueue<task_node*>(queue_capacity)}, rejected_(0), sleeping_(0), ready_(0), tg_(threads_){
     for(int i = 0; i < nthreads; ++i){
-        threads_.push_back(std::thread(
-            [this]{
-                while(!stop_.load(std::memory_order_acquire)){
-                    task_type task_;
-                    {
-                        std::unique_lock<std::mutex> ulk(this->mtx_);
-                        this->cond_.wait(ulk, [this]{ return stop_.load(std::memory_order_acquire) || !this->tasks_.empty(); });
-                        if(stop_.load(std::memory_order_acquire))
-                            return;
-                        task_ = std::move(this->tasks_.front());
-                        this->tasks_.pop();
-                    }
-                    task_();
-                }
+        int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        threads_.push_back(std::thread([this, i, cpu]{
+            if(cpu >= 0)
+                pin_thread(cpu);
+            workers_[i].reset(new worker);
+            workers_[i]->rng = 2654435761u * (i + 1);
+            workers_[i]->high_streak = 0;
+            // 所有工作线程都分配好自己的队列之后才开始取任务, 窃取时不会访问到空指针
+            {
+                std::unique_lock<std::mutex> ulk(mtx_);
+                if(++ready_ == nthreads)
+                    cond_.notify_all();
+                else
+                    cond_.wait(ulk, [this]{ return ready_ == nthreads; });
             }
-        ));
+            worker_loop(i);
+        }));
     }
+    std::unique_lock<std::mutex> ulk(mtx_);
+    cond_.wait(ulk, [this]{ return ready_ == nthreads; });
 }
 
 void ThreadPool::stop(){
@@ -27,5 +56,178 @@ void ThreadPool::stop(){
 
 ThreadPool::~ThreadPool(){
     stop();
+    {
+        std::lock_guard<std::mutex> lg(mtx_);
+    }
     cond_.notify_all();
+    for(size_t i = 0; i != threads_.size(); ++i){
+        if(threads_[i].joinable())
+            threads_[i].join();
+    }
+    // 工作线程都已退出, 释放没有执行的任务
+    for(int i = 0; i < nthreads; ++i){
+        while(task_node* t = workers_[i]->deque.pop())
+            free_node(t);
+    }
+    task_node* t;
+    for(int p = 0; p < PRIORITY_COUNT; ++p){
+        while(injected_[p].pop(t))
+            free_node(t);
+    }
+}
+
+ThreadPool::task_node* ThreadPool::alloc_node(){
+    task_node* t = arena_.alloc();
+    if(!t){
+        // 对象池用尽 (积压超过百万个任务), 退回到堆上分配
+        t = new task_node;
+        t->arena_index = TaskArena<task_node>::HEAP_INDEX;
+    }
+    return t;
+}
+
+void ThreadPool::free_node(task_node* t){
+    t->fn.reset();
+    if(t->arena_index == TaskArena<task_node>::HEAP_INDEX)
+        delete t;
+    else
+        arena_.free(t);
+}
+
+bool ThreadPool::try_submit(task_node* t, task_priority priority){
+    if(priority == PRIORITY_NORMAL && current_pool == this && workers_[current_worker]->deque.push(t)){
+        wake_one();
+        return true;
+    }
+    if(!injected_[priority].push(t))
+        return false;
+    wake_one();
+    return true;
+}
+
+void ThreadPool::submit(task_node* t, task_priority priority){
+    while(!try_submit(t, priority)){
+        // 停止后不再有人取任务, 和其他未执行的任务一样丢弃
+        if(stop_.load(std::memory_order_acquire)){
+            free_node(t);
+            return;
+        }
+        // 工作线程自己等待可能永远等不到空间, 直接执行
+        if(current_pool == this){
+            t->fn();
+            free_node(t);
+            return;
+        }
+        std::this_thread::yield();
+    }
+}
+
+// 与睡眠前的检查配对: 提交方先放入任务再读 sleeping_, 睡眠方先增加 sleeping_ 再检查任务,
+// 两边都有 seq_cst 栅栏, 至少一方能看到另一方
+void ThreadPool::wake_one(){
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(sleeping_.load(std::memory_order_relaxed) == 0)
+        return;
+    {
+        std::lock_guard<std::mutex> lg(mtx_);
+    }
+    cond_.notify_one();
+}
+
+ThreadPool::task_node* ThreadPool::take_injected(int id){
+    MpmcQueue<task_node*>& injected = injected_[PRIORITY_NORMAL];
+    task_node* first;
+    if(!injected.pop(first))
+        return nullptr;
+    // 按线程数平分剩余的任务, 其余线程可以从这里窃取
+    size_t n = injected.size() / nthreads + 1;
+    if(n > INJECT_BATCH)
+        n = INJECT_BATCH;
+    worker& w = *workers_[id];
+    size_t more = 0;
+    task_node* t;
+    // 只有本线程向自己的队列 push, 检查过有空位之后 push 一定成功
+    while(more + 1 < n && w.deque.size() < w.deque.capacity() && injected.pop(t)){
+        w.deque.push(t);
+        ++more;
+    }
+    if(more > 0)
+        wake_one();
+    return first;
+}
+
+ThreadPool::task_node* ThreadPool::steal_task(int id){
+    if(nthreads <= 1)
+        return nullptr;
+    int start = xorshift(workers_[id]->rng) % nthreads;
+    for(int i = 0; i < nthreads; ++i){
+        int victim = (start + i) % nthreads;
+        if(victim == id)
+            continue;
+        if(task_node* t = workers_[victim]->deque.steal())
+            return t;
+    }
+    return nullptr;
+}
+
+ThreadPool::task_node* ThreadPool::find_normal_task(int id){
+    if(task_node* t = workers_[id]->deque.pop())
+        return t;
+    if(task_node* t = take_injected(id))
+        return t;
+    return steal_task(id);
+}
+
+ThreadPool::task_node* ThreadPool::find_task(int id){
+    worker& w = *workers_[id];
+    task_node* t;
+    if(w.high_streak < HIGH_BURST && injected_[PRIORITY_HIGH].pop(t)){
+        ++w.high_streak;
+        return t;
+    }
+    // 连续执行了 HIGH_BURST 个高优先级任务, 或者没有高优先级任务
+    if((t = find_normal_task(id)) != nullptr){
+        w.high_streak = 0;
+        return t;
+    }
+    if(injected_[PRIORITY_HIGH].pop(t)){
+        w.high_streak = 1;
+        return t;
+    }
+    return nullptr;
+}
+
+bool ThreadPool::has_work(){
+    for(int p = 0; p < PRIORITY_COUNT; ++p){
+        if(!injected_[p].empty())
+            return true;
+    }
+    for(int i = 0; i < nthreads; ++i){
+        if(!workers_[i]->deque.empty())
+            return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(int id){
+    current_pool = this;
+    current_worker = id;
+    while(!stop_.load(std::memory_order_acquire)){
+        task_node* t = find_task(id);
+        for(int spin = 0; !t && spin < SPIN_ROUNDS && !stop_.load(std::memory_order_acquire); ++spin){
+            std::this_thread::yield();
+            t = find_task(id);
+        }
+        if(!t){
+            std::unique_lock<std::mutex> ulk(mtx_);
+            sleeping_.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(!stop_.load(std::memory_order_acquire) && !has_work())
+                cond_.wait(ulk);
+            sleeping_.fetch_sub(1, std::memory_order_relaxed);
+            continue;
+        }
+        t->fn();
+        free_node(t);
+    }
 }
@@ -0,0 +1,99 @@
+#include "../include/TimingWheel.hpp"
+
+TimingWheel::TimingWheel(uint64_t tick_ms) : tick_ms_(tick_ms ? tick_ms : 1), current_(now_ms() / tick_ms_), size_(0){
+    for(int level = 0; level < LEVELS; ++level){
+        for(int i = 0; i < SLOTS; ++i){
+            slots_[level][i].prev = &slots_[level][i];
+            slots_[level][i].next = &slots_[level][i];
+        }
+    }
+}
+
+void TimingWheel::schedule(timer_node* t, uint64_t now_ms, uint64_t delay_ms){
+    if(t->linked())
+        unlink(t);
+    uint64_t expire = (now_ms + delay_ms + tick_ms_ - 1) / tick_ms_;
+    t->expire = expire > current_ ? expire : current_ + 1;
+    link(t);
+}
+
+void TimingWheel::schedule_no_later(timer_node* t, uint64_t now_ms, uint64_t delay_ms){
+    uint64_t expire = (now_ms + delay_ms + tick_ms_ - 1) / tick_ms_;
+    if(t->linked() && t->expire <= expire)
+        return;
+    schedule(t, now_ms, delay_ms);
+}
+
+void TimingWheel::cancel(timer_node* t){
+    if(t->linked())
+        unlink(t);
+}
+
+int TimingWheel::next_timeout(uint64_t now_ms) const{
+    if(size_ == 0)
+        return -1;
+    // 第 0 层中最近的非空槽, 找不到时在第 0 层转完一圈(需要级联)时醒来
+    uint64_t ticks = SLOTS - (current_ & (SLOTS - 1));
+    for(uint64_t i = 1; i < ticks; ++i){
+        const timer_node* head = &slots_[0][(current_ + i) & (SLOTS - 1)];
+        if(head->next != head){
+            ticks = i;
+            break;
+        }
+    }
+    uint64_t when = (current_ + ticks) * tick_ms_;
+    return when > now_ms ? (int)(when - now_ms) : 0;
+}
+
+void TimingWheel::link(timer_node* t){
+    uint64_t delta = t->expire - current_;
+    int level = 0;
+    while(level < LEVELS - 1 && delta >= (1ULL << (SLOT_BITS * (level + 1))))
+        ++level;
+    // 超出最高层范围的定时器放在最高层最远处, 级联时再重新计算
+    uint64_t max_delta = (1ULL << (SLOT_BITS * LEVELS)) - 1;
+    if(delta > max_delta)
+        t->expire = current_ + max_delta;
+
+    timer_node* head = &slots_[level][(t->expire >> (SLOT_BITS * level)) & (SLOTS - 1)];
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+    ++size_;
+}
+
+void TimingWheel::unlink(timer_node* t){
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->prev = t->next = nullptr;
+    --size_;
+}
+
+// 第 0 层转完一圈时, 把上一层当前槽的节点重新分配到下层, 上一层也转完一圈时继续向上
+void TimingWheel::cascade(){
+    for(int level = 1; level < LEVELS; ++level){
+        uint64_t idx = (current_ >> (SLOT_BITS * level)) & (SLOTS - 1);
+        timer_node moved;
+        splice(&slots_[level][idx], &moved);
+        while(moved.next != &moved){
+            timer_node* t = moved.next;
+            unlink(t);
+            link(t);
+        }
+        if(idx != 0)
+            break;
+    }
+}
+
+void TimingWheel::splice(timer_node* from, timer_node* to){
+    if(from->next == from){
+        to->prev = to->next = to;
+        return;
+    }
+    to->next = from->next;
+    to->prev = from->prev;
+    to->next->prev = to;
+    to->prev->next = to;
+    from->prev = from->next = from;
+}
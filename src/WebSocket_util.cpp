@@ -1,24 +1,25 @@
 #include "../include/WebSocket_util.hpp"
 
-std::string decode_websocket_frame(const std::vector<uint8_t>& buffer) {
-    if (buffer.size() < 6) return "";
+ws_frame_result decode_websocket_frame(const char* data, size_t len, uint8_t& opcode, bool& fin, std::string& payload, size_t& consumed) {
+    const uint8_t* buffer = (const uint8_t*)data;
+    consumed = WS_MAX_HEADER;
+    if (len < 2) return WS_FRAME_AGAIN;
 
     size_t i = 0;
-    uint8_t fin = (buffer[i] & 0x80) >> 7;
-    uint8_t opcode = buffer[i] & 0x0F;
+    fin = buffer[i] & 0x80;
+    opcode = buffer[i] & 0x0F;
     i++;
 
-    if(opcode == 0x8)
-        return "";
-
     uint8_t mask = (buffer[i] & 0x80) >> 7;
     uint64_t payload_len = buffer[i] & 0x7F;
     i++;
 
     if (payload_len == 126) {
+        if (len < i + 2) return WS_FRAME_AGAIN;
         payload_len = (buffer[i] << 8) | buffer[i + 1];
         i += 2;
     } else if (payload_len == 127) {
+        if (len < i + 8) return WS_FRAME_AGAIN;
         payload_len = 0;
         for (int j = 0; j < 8; ++j) {
             payload_len = (payload_len << 8) | buffer[i + j];
@@ -26,7 +27,14 @@ std::string decode_websocket_frame(const std::vector<uint8_t>& buffer) {
         i += 8;
     }
 
-    if (mask != 1) return "";  // 客户端发来的必须带掩码
+    if (mask != 1) return WS_FRAME_ERROR;  // 客户端发来的必须带掩码
+    if (payload_len > MAX_WS_PAYLOAD) return WS_FRAME_ERROR;
+    // 控制帧 (close/ping/pong) 不能分片, 负载不超过 125 字节
+    if ((opcode & 0x8) && (!fin || payload_len > 125)) return WS_FRAME_ERROR;
+    if (len < i + 4 + payload_len) {
+        consumed = i + 4 + payload_len;
+        return WS_FRAME_AGAIN;
+    }
 
     // 读取 masking key
     uint8_t masking_key[4];
@@ -35,21 +43,20 @@ std::string decode_websocket_frame(const std::vector<uint8_t>& buffer) {
     }
 
     // 解码 payload
-    std::string decoded;
-    for (uint64_t j = 0; j < payload_len && i + j < buffer.size(); ++j) {
-        char byte = buffer[i + j] ^ masking_key[j % 4];
-        decoded += byte;
+    payload.resize(payload_len);
+    for (uint64_t j = 0; j < payload_len; ++j) {
+        payload[j] = buffer[i + j] ^ masking_key[j % 4];
     }
-
-    return decoded;
+    consumed = i + payload_len;
+    return WS_FRAME_OK;
 }
 
-std::vector<uint8_t> build_websocket_text_frame(const std::string& message) {
+std::vector<uint8_t> build_websocket_frame(uint8_t opcode, const std::string& message) {
     std::vector<uint8_t> frame;
     size_t len = message.size();
 
-    // 第一个字节：FIN=1, opcode=0x1 (text)
-    frame.push_back(0x81);
+    // 第一个字节：FIN=1, opcode
+    frame.push_back(0x80 | opcode);
 
     // 第二个字节：mask=0（服务器不用掩码）
     if (len <= 125) {
@@ -70,25 +77,79 @@ std::vector<uint8_t> build_websocket_text_frame(const std::string& message) {
     return frame;
 }
 
-void websocket_response(void* ptr, EpollWrapper &ew){
-    uint8_t buffer[4096];
-    std::vector<uint8_t> recv_buffer;
-    while (true){
-        ssize_t n = read(((connection*)ptr)->fd, buffer, sizeof(buffer));
-        if(n <= 0)
-            break;
-        recv_buffer.insert(recv_buffer.end(), buffer, buffer + n);
-    }
+std::vector<uint8_t> build_websocket_text_frame(const std::string& message) {
+    return build_websocket_frame(0x1, message);
+}
 
-    std::string msg = decode_websocket_frame(recv_buffer);
-    std::string combined_msg = fd_to_user[((connection*)ptr)->fd] + ": " + msg;
-    std::vector<uint8_t> frame = build_websocket_text_frame(combined_msg);
+// 按顺序处理 in_buf 中所有完整的帧, 不完整的帧留到下一次可读, wanted 为它需要的长度; 需要关闭连接时返回 true
+static bool handle_websocket_frames(connection* conn, size_t& wanted){
+    size_t offset = 0;
+    bool shutdown_wr = false;
+    wanted = WS_MAX_HEADER;
+    while(offset < conn->in_buf.size()){
+        uint8_t opcode;
+        bool fin;
+        std::string payload;
+        size_t consumed;
+        ws_frame_result result = decode_websocket_frame(&conn->in_buf[offset], conn->in_buf.size() - offset, opcode, fin, payload, consumed);
+        if(result == WS_FRAME_AGAIN){
+            wanted = consumed;
+            break;
+        }
+        // 协议错误或 close 帧: 丢弃剩余数据, 关闭连接
+        if(result == WS_FRAME_ERROR || opcode == 0x8){
+            offset = conn->in_buf.size();
+            shutdown_wr = true;
+            break;
+        }
+        offset += consumed;
+        // ping 原样回复 pong, 客户端的 pong 不需要处理
+        if(opcode == 0x9){
+            std::vector<uint8_t> pong = build_websocket_frame(0xA, payload);
+            conn->send(pong.data(), pong.size());
+            continue;
+        }
+        if(opcode == 0xA)
+            continue;
 
-    if(msg.size() != 0)
-        for(auto iter : user_to_connection){
-            if(iter.second && iter.second->fd != ((connection*)ptr)->fd)
-                send(iter.second->fd, frame.data(), frame.size(), 0);
+        // 数据帧: 0x1/0x2 开始一条消息, 0x0 是未完成消息的后续分片
+        if((opcode == 0x0) != (conn->ws_msg_opcode != 0) || conn->ws_message.size() + payload.size() > MAX_WS_PAYLOAD){
+            offset = conn->in_buf.size();
+            shutdown_wr = true;
+            break;
+        }
+        if(opcode != 0x0)
+            conn->ws_msg_opcode = opcode;
+        if(!fin){
+            conn->ws_message += payload;
+            continue;
         }
+        // 没有分片的消息直接使用这一帧的负载
+        std::string msg = conn->ws_message.empty() ? std::move(payload) : std::move(conn->ws_message) + payload;
+        uint8_t type = conn->ws_msg_opcode;
+        conn->ws_message.clear();
+        conn->ws_msg_opcode = 0;
+        if(type == 0x1 && msg.size() != 0)
+            broadcast_chat(conn, msg);
+    }
+    conn->in_buf.erase(0, offset);
+    return shutdown_wr;
+}
 
-    ew.mod_fd(ptr, ((connection*)ptr)->fd, EPOLLONESHOT | EPOLLIN | EPOLLERR | EPOLLRDHUP | EPOLLHUP | EPOLLET);
-}
\ No newline at end of file
+bool websocket_response(connection* conn){
+    size_t wanted;
+    // 升级请求之后同一次读到的帧已经在 in_buf 中, 先处理它们
+    if(handle_websocket_frames(conn, wanted))
+        return true;
+    // 每轮最多读到当前帧的长度再加一次 recv, 处理完再继续读, 缓冲区不超过一个最大帧
+    while(true){
+        size_t limit = wanted + HTTP_READ_CHUNK;
+        bool eof = read_http_request(conn->fd, conn->in_buf, limit) < 0;
+        bool more = conn->in_buf.size() >= limit;
+        // 对端关闭时处理完已经收到的帧, 之后关闭写端
+        if(handle_websocket_frames(conn, wanted) || eof)
+            return true;
+        if(!more)
+            return false;
+    }
+}
@@ -5,7 +5,7 @@
 
 #include "../include/server.hpp"
 #include "../include/ThreadPool.hpp"
-#include "../include/EpollWrapper.hpp"
+#include "../include/Poller.hpp"
 #include "../include/HttpData.hpp"
 
 void test(int a){
@@ -18,12 +18,39 @@ int main(int argc, char* argv[]){
     uint16_t http_port = 8080;
     uint16_t qt_port = 45678;
 
+    server_options opts;
+
     if(argc > 2){
         ip = argv[1];
         http_port = std::stoi(argv[2]);
     }
+    if(argc > 3){
+        opts.reactors = std::stoi(argv[3]);
+    }
+    // 其余参数: uring 使用 io_uring 后端, et 使用持久的边沿触发注册, queue=N 设置线程池队列容量,
+    // workers=N 设置工作线程数, pin 把线程绑定到 CPU, shared 让所有 reactor 共用一个监听套接字 (EPOLLEXCLUSIVE),
+    // header_timeout=MS 设置收齐一个请求的期限, stats=MS 设置线程池积压的报告间隔 (0 关闭)
+    for(int i = 4; i < argc; ++i){
+        std::string arg = argv[i];
+        if(arg == "uring")
+            opts.backend = IO_URING;
+        else if(arg == "et")
+            opts.persistent_registration = true;
+        else if(arg.compare(0, 6, "queue=") == 0)
+            opts.task_queue_capacity = std::stoul(arg.substr(6));
+        else if(arg.compare(0, 8, "workers=") == 0)
+            opts.workers = std::stoi(arg.substr(8));
+        else if(arg == "pin")
+            opts.pin_threads = true;
+        else if(arg == "shared")
+            opts.shared_listener = true;
+        else if(arg.compare(0, 15, "header_timeout=") == 0)
+            opts.header_timeout_ms = std::stoi(arg.substr(15));
+        else if(arg.compare(0, 6, "stats=") == 0)
+            opts.stats_interval_ms = std::stoi(arg.substr(6));
+    }
 
-    server s(ip, http_port, qt_port);
+    server s(ip, http_port, qt_port, opts);
     s.start();
 
     // std::string http_request =
@@ -2,12 +2,48 @@
 
 std::function<void()> signal_handler_;
 
+// 任务执行中或未设置超时的连接, 到期后隔多久再检查一次
+const uint64_t TIMEOUT_RECHECK_MS = 1000;
+// 有任务因线程池队列满而推迟时, 事件等待的最长时间
+const int DEFERRED_RETRY_MS = 1;
+
 void bridge(int signo){
     if(signal_handler_){
         signal_handler_();
     }
 }
 
+// 线程池中处理一个连接的任务
+// 持久注册时, 执行期间到达的数据不会再触发新任务, end_task 返回 false 时在这里继续处理
+static void serve_connection(conn_handle h){
+    // 任务排队期间连接可能已被关闭, 拿到引用之后才能访问
+    conn_ref conn(connections, h);
+    if(!conn)
+        return;
+    bool shutdown_wr;
+    do{
+        // 处理过程中连接可能从 HTTP 升级为 WebSocket
+        switch (conn->conn_type)
+        {
+        case HTTP:
+            shutdown_wr = http_response(conn.get());
+            // 与升级请求一起到达的 WebSocket 帧已经读进 in_buf, 不会再有可读事件, 在这里处理
+            if(!shutdown_wr && conn->conn_type == WEBSOCKET && !conn->in_buf.empty())
+                shutdown_wr = websocket_response(conn.get());
+            break;
+        case WEBSOCKET:
+            shutdown_wr = websocket_response(conn.get());
+            break;
+        case QT:
+            shutdown_wr = qt_response(conn.get());
+            break;
+        default:
+            shutdown_wr = false;
+            break;
+        }
+    }while(!conn->end_task(shutdown_wr));
+}
+
 void set_nonblocking(int fd){
     int flags = fcntl(fd, F_GETFL, 0);
     if (flags == -1) {
@@ -19,122 +55,457 @@ void set_nonblocking(int fd){
     }
 }
 
-std::map<std::string, std::shared_ptr<connection>> user_to_connection;
-std::unordered_map<int, std::string> fd_to_user;
-std::unordered_map<int, std::shared_ptr<connection>> connections;
+ConnectionTable connections;
+
+std::mutex conn_mtx;
+std::map<std::string, connection*> user_to_connection;
 
+static uint32_t next_user_id = 1;
+
+bool register_user(connection* conn, const std::string& name, connProto type){
+    std::lock_guard<std::mutex> lg(conn_mtx);
+    // 已被 reactor 关闭的连接不能再进入用户表, 否则会留下失效的指针
+    if(conn->is_closed())
+        return false;
+    if(!conn->username.empty()){
+        auto iter = user_to_connection.find(conn->username);
+        if(iter != user_to_connection.end() && iter->second == conn)
+            user_to_connection.erase(iter);
+    }
+    conn->conn_type = type;
+    conn->username = name;
+    conn->user_id = next_user_id++;
+    user_to_connection[name] = conn;
+    return true;
+}
+
+void unregister_user(connection* conn){
+    std::lock_guard<std::mutex> lg(conn_mtx);
+    if(conn->username.empty())
+        return;
+    // 同名用户重新登录后, 表中已经是新连接
+    auto iter = user_to_connection.find(conn->username);
+    if(iter != user_to_connection.end() && iter->second == conn)
+        user_to_connection.erase(iter);
+    conn->username.clear();
+}
 
-server::server(const char* ip, uint16_t http_port, uint16_t qt_port) : stop(false), ew(), thread_pool(24){
+bool broadcast_chat(connection* from, const std::string& msg){
+    std::lock_guard<std::mutex> lg(conn_mtx);
+    // 登录状态与 unregister_user 在同一把锁下判断
+    if(from->username.empty())
+        return false;
+    std::string text = from->username + ": " + msg;
+    // 每种协议只编码一次
+    std::vector<uint8_t> ws_frame;
+    std::string qt_frame;
+    for(auto& iter : user_to_connection){
+        connection* to = iter.second;
+        if(!to || to == from)
+            continue;
+        if(to->conn_type == QT){
+            if(qt_frame.empty())
+                qt_frame = encode_qt_frame(QT_CHAT, from->user_id, text);
+            to->send(qt_frame.data(), qt_frame.size());
+        }
+        else{
+            if(ws_frame.empty())
+                ws_frame = build_websocket_text_frame(text);
+            to->send(ws_frame.data(), ws_frame.size());
+        }
+    }
+    return true;
+}
+
+
+// 工作线程的 CPU: 跳过 reactor 占用的前几个, 按交错排列的顺序分配
+static std::vector<int> worker_cpus(const server_options& opts){
+    if(!opts.pin_threads)
+        return std::vector<int>();
+    std::vector<int> cpus = placement_cpus();
+    size_t reactors = opts.reactors > 1 ? opts.reactors : 1;
+    std::vector<int> out;
+    for(size_t i = 0; i < cpus.size(); ++i)
+        out.push_back(cpus[(reactors + i) % cpus.size()]);
+    return out;
+}
+
+server::server(const char* ip, uint16_t http_port, uint16_t qt_port, const server_options& opts)
+    : opts_(opts), stop(false), thread_pool(opts.workers, opts.task_queue_capacity, worker_cpus(opts)){
     http_address.sin_family = AF_INET;
     http_address.sin_port = htons(http_port);
     inet_aton(ip, &http_address.sin_addr);
-    http_listen_sock_ = -1;
 
     qt_address.sin_family = AF_INET;
     qt_address.sin_port = htons(qt_port);
     inet_aton(ip, &qt_address.sin_addr);
     qt_listen_sock_ = -1;
+    event_fd_ = -1;
+
+    if(opts_.reactors < 1)
+        opts_.reactors = 1;
+    if(opts_.accept_batch < 1)
+        opts_.accept_batch = 1;
+
+    conn_timeouts.header_ms = opts_.header_timeout_ms > 0 ? opts_.header_timeout_ms : 0;
+    conn_timeouts.idle_ms = opts_.idle_timeout_ms > 0 ? opts_.idle_timeout_ms : 0;
+    conn_timeouts.ws_idle_ms = opts_.ws_idle_timeout_ms > 0 ? opts_.ws_idle_timeout_ms : 0;
+    conn_timeouts.write_ms = opts_.write_timeout_ms > 0 ? opts_.write_timeout_ms : 0;
 };
 
 void server::end(){
-    stop = true;
-    close(http_listen_sock_);
+    stop.store(true, std::memory_order_release);
+    // 唤醒其他 reactor, eventfd 注册在每个 epoll 中且从不读取, 所以所有 reactor 都会醒来
+    uint64_t val = 1;
+    write(event_fd_, &val, sizeof(val));
 }
 
-int server::start(){
-    if(http_listen_sock_ > 0)
+int server::open_http_listener(){
+    int sock = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sock < 0)
         return -1;
-    http_listen_sock_ = socket(PF_INET, SOCK_STREAM, 0);
-    int ret = bind(http_listen_sock_, (struct sockaddr*)&http_address, sizeof(http_address));
+    // 和 qt 监听套接字一样, 重启时不必等待上次的连接离开 TIME_WAIT
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if(opts_.reactors > 1 && !opts_.shared_listener){
+        if(setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0){
+            perror("[ERROR] setsockopt SO_REUSEPORT failed");
+            close(sock);
+            return -1;
+        }
+    }
+    int ret = bind(sock, (struct sockaddr*)&http_address, sizeof(http_address));
     assert(ret != -1);
-    listen(http_listen_sock_, 1024);
-    connection* hl = new connection(http_listen_sock_, OTHER);
-    ew.add_fd((void*)hl, http_listen_sock_, EPOLLIN | EPOLLERR);
+    listen(sock, 1024);
+    return sock;
+}
 
+int server::start(){
+    if(!reactors_.empty())
+        return -1;
+    int shared_sock = -1;
+    if(opts_.shared_listener){
+        shared_sock = open_http_listener();
+        if(shared_sock < 0)
+            return -1;
+    }
+    std::vector<int> cpus = opts_.pin_threads ? placement_cpus() : std::vector<int>();
+    for(int i = 0; i < opts_.reactors; ++i){
+        std::unique_ptr<reactor> r;
+        if(cpus.empty())
+            r = std::make_unique<reactor>(i, opts_.backend);
+        else{
+            // 在目标 CPU 上构造, 时间轮和事件数组位于 reactor 线程的本地节点
+            int cpu = cpus[i % cpus.size()];
+            run_on_cpu(cpu, [&r, i, this]{ r = std::make_unique<reactor>(i, opts_.backend); });
+            r->cpu = cpu;
+        }
+        r->http_listen_sock_ = opts_.shared_listener ? shared_sock : open_http_listener();
+        if(r->http_listen_sock_ < 0)
+            return -1;
+        // 不在连接表中的 fd 以代数 0 的句柄注册
+        r->multishot_accept = r->poller->accept_multishot(r->http_listen_sock_, make_handle(r->http_listen_sock_, 0));
+        if(!r->multishot_accept){
+            // 监听套接字使用边沿触发, accept_connections 一次性取到 EAGAIN
+            uint32_t listen_events = EPOLLIN | EPOLLERR | EPOLLET;
+            if(opts_.shared_listener)
+                listen_events |= EPOLLEXCLUSIVE;
+            r->poller->add_fd(make_handle(r->http_listen_sock_, 0), r->http_listen_sock_, listen_events);
+        }
+        reactors_.push_back(std::move(r));
+    }
+
+    // qt 监听套接字只挂在第一个 reactor 上
     if(qt_listen_sock_ > 0)
         return -1;
-    qt_listen_sock_ = socket(PF_INET, SOCK_STREAM, 0);
-    ret = bind(qt_listen_sock_, (struct sockaddr*)&qt_address, sizeof(qt_address));
+    qt_listen_sock_ = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    // 固定端口, 重启时不必等待上次关闭的连接离开 TIME_WAIT
+    int on = 1;
+    setsockopt(qt_listen_sock_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    int ret = bind(qt_listen_sock_, (struct sockaddr*)&qt_address, sizeof(qt_address));
     assert(ret != -1);
     listen(qt_listen_sock_, 1024);
-    connection* ql = new connection(qt_listen_sock_, OTHER);
-    ew.add_fd((void*)ql, qt_listen_sock_, EPOLLIN | EPOLLERR);
+    reactors_[0]->poller->add_fd(make_handle(qt_listen_sock_, 0), qt_listen_sock_, EPOLLIN | EPOLLERR | EPOLLET);
+
+    // 静态资源缓存的 inotify 事件由 reactor 0 处理
+    if(asset_cache.init())
+        reactors_[0]->poller->add_fd(make_handle(asset_cache.notify_fd(), 0), asset_cache.notify_fd(), EPOLLIN);
 
     // 处理退出
-    int event_fd = eventfd(0, EFD_NONBLOCK);
-    connection* event_conn = new connection(event_fd, OTHER);
-    ew.add_fd((void*)event_conn, event_fd, EPOLLIN);
-    signal_handler_ = [&event_fd](){
+    event_fd_ = eventfd(0, EFD_NONBLOCK);
+    for(auto& r : reactors_)
+        r->poller->add_fd(make_handle(event_fd_, 0), event_fd_, EPOLLIN);
+    signal_handler_ = [this](){
         uint64_t val = 1;
-        write(event_fd, &val, sizeof(val));
+        write(event_fd_, &val, sizeof(val));
     };
     signal(SIGINT, bridge);
 
-    while(!stop){
-        int num_of_events = ew.wait();
+    std::cout << "[INFO] Server started with " << reactors_.size() << " reactor(s), backend: " << reactors_[0]->poller->name() << ", registration: " << (opts_.persistent_registration ? "edge-triggered" : "oneshot") << std::endl;
+    report_placement();
+
+    for(size_t i = 1; i < reactors_.size(); ++i){
+        reactor* r = reactors_[i].get();
+        r->thread_ = std::thread([this, r]{
+            if(r->cpu >= 0)
+                pin_thread(r->cpu);
+            run_reactor(*r);
+        });
+    }
+    // reactor 0 在当前线程中运行
+    if(reactors_[0]->cpu >= 0)
+        pin_thread(reactors_[0]->cpu);
+    run_reactor(*reactors_[0]);
+
+    for(auto& r : reactors_){
+        if(r->thread_.joinable())
+            r->thread_.join();
+        if(r->id == 0 || !opts_.shared_listener)
+            close(r->http_listen_sock_);
+    }
+    close(qt_listen_sock_);
+    close(event_fd_);
+    std::cout << "[INFO] Thread pool queue depth " << thread_pool.queue_depth(PRIORITY_HIGH) << "+" << thread_pool.queue_depth(PRIORITY_NORMAL)
+              << "/" << thread_pool.queue_capacity() << ", rejected submissions " << thread_pool.rejected() << std::endl;
+    return 0;
+}
+
+// 注入队列中有积压, 或者上次报告以来有提交被拒绝 (连接被推迟) 时打印, 空闲时不输出
+void server::report_backpressure(reactor& r){
+    size_t high = thread_pool.queue_depth(PRIORITY_HIGH);
+    size_t normal = thread_pool.queue_depth(PRIORITY_NORMAL);
+    uint64_t rejected = thread_pool.rejected();
+    if(high == 0 && normal == 0 && rejected == r.reported_rejected)
+        return;
+    std::cout << "[INFO] Thread pool queue depth " << high << "+" << normal << "/" << thread_pool.queue_capacity()
+              << ", rejected submissions " << rejected - r.reported_rejected << " (total " << rejected << ")" << std::endl;
+    r.reported_rejected = rejected;
+}
+
+// 启动时打印线程的 CPU 和 NUMA 节点分配
+void server::report_placement(){
+    std::vector<int> cpus = placement_cpus();
+    std::cout << "[INFO] Placement: " << numa_node_count() << " NUMA node(s), " << cpus.size() << " CPU(s), "
+              << reactors_.size() << " reactor(s), " << thread_pool.size() << " worker(s)";
+    if(!opts_.pin_threads){
+        std::cout << ", threads not pinned" << std::endl;
+        return;
+    }
+    std::cout << std::endl;
+    for(auto& r : reactors_)
+        std::cout << "[INFO]   reactor " << r->id << " -> cpu " << r->cpu << " (node " << cpu_node(r->cpu) << ")" << std::endl;
+    // 工作线程按节点汇总
+    std::vector<int> wcpus = worker_cpus(opts_);
+    std::vector<std::string> per_node(numa_node_count());
+    std::vector<int> counts(numa_node_count(), 0);
+    for(int i = 0; i < thread_pool.size(); ++i){
+        int cpu = wcpus[i % wcpus.size()];
+        int node = cpu_node(cpu);
+        per_node[node] += (counts[node]++ ? "," : "") + std::to_string(cpu);
+    }
+    for(size_t node = 0; node < per_node.size(); ++node){
+        if(counts[node] > 0)
+            std::cout << "[INFO]   node " << node << ": " << counts[node] << " worker(s) on cpu " << per_node[node] << std::endl;
+    }
+}
+
+// 批量 accept, 直到 EAGAIN 或达到 accept_batch 上限
+// 返回 false 表示还有未处理的连接, 需要在下一轮继续
+bool server::accept_connections(reactor& r, int listen_sock, connProto type, bool multishot){
+    for(int n = 0; n < opts_.accept_batch; ++n){
+        int connfd;
+        if(multishot){
+            if(r.poller->take_accepted(make_handle(listen_sock, 0), &connfd, 1) == 0)
+                return true;
+        }
+        else
+            connfd = accept4(listen_sock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(connfd < 0){
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if(errno == EINTR || errno == ECONNABORTED || errno == EPROTO)
+                continue;
+            // EMFILE/ENFILE 等, 等下一个新连接的边沿再试
+            perror("[ERROR] accept4 failed");
+            return true;
+        }
+        //std::cout << "accept fd = " << connfd << std::endl;
+        connection* conn = connections.open(connfd, type, r.poller.get());
+        if(!conn){
+            fprintf(stderr, "[ERROR] fd %d exceeds connection table capacity\n", connfd);
+            close(connfd);
+            continue;
+        }
+        conn->oneshot = !opts_.persistent_registration;
+        conn->touch(conn_timeouts.header_ms);
+        r.wheel.schedule(&conn->timer, TimingWheel::now_ms(), conn_timeouts.header_ms ? conn_timeouts.header_ms : TIMEOUT_RECHECK_MS);
+        if(conn->oneshot)
+            r.poller->add_fd(conn->handle(), connfd, EPOLLONESHOT | EPOLLIN | EPOLLERR | EPOLLRDHUP | EPOLLHUP | EPOLLET);
+        else
+            r.poller->add_fd(conn->handle(), connfd, EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLRDHUP | EPOLLHUP | EPOLLET);
+    }
+    return false;
+}
+
+void server::close_connection(reactor& r, connection* conn){
+    int fd = conn->fd;
+    r.wheel.cancel(&conn->timer);
+    r.poller->del_fd(fd);
+    // 先标记关闭, register_user 看到后就不会再把它加入用户表
+    conn->mark_closed();
+    // 广播时持有 conn_mtx, 移出用户表之后就不会再有其他线程拿到这个连接
+    unregister_user(conn);
+    //std::cout << "[INFO] Connection closed by client: " << fd << std::endl;
+    // fd 在最后一个引用释放时才关闭, 执行中的任务不会读写到复用这个 fd 的新连接
+    connections.close(fd);
+}
+
+// 时间轮到期回调, deadline 只会被工作线程推后, 没到期时按新的 deadline 重新调度
+void server::on_timeout(reactor& r, connection* conn){
+    uint64_t now = TimingWheel::now_ms();
+    uint64_t deadline = conn->deadline.load(std::memory_order_acquire);
+    if(deadline == connection::NO_DEADLINE){
+        // 任务执行中或不限制超时, 稍后再检查
+        r.wheel.schedule(&conn->timer, now, TIMEOUT_RECHECK_MS);
+    }
+    else if(now < deadline){
+        r.wheel.schedule(&conn->timer, now, deadline - now);
+    }
+    else{
+        close_connection(r, conn);
+    }
+}
+
+// 提交处理连接的任务, 队列满时推迟, 已有同优先级的推迟任务时排在它们后面, 保证同一 reactor 内的顺序
+void server::dispatch(reactor& r, conn_handle h, task_priority priority){
+    std::vector<conn_handle>& deferred = r.deferred[priority];
+    if(!deferred.empty() || !thread_pool.try_post([h]{ serve_connection(h); }, priority))
+        deferred.push_back(h);
+}
+
+// 按顺序重新提交推迟的任务, 全部提交成功时返回 true
+// 推迟期间连接可能已被关闭, 过期的句柄由 serve_connection 丢弃
+bool server::retry_deferred(reactor& r){
+    bool all = true;
+    for(int p = 0; p < PRIORITY_COUNT; ++p){
+        std::vector<conn_handle>& deferred = r.deferred[p];
+        size_t n = 0;
+        while(n < deferred.size()){
+            conn_handle h = deferred[n];
+            if(!thread_pool.try_post([h]{ serve_connection(h); }, (task_priority)p))
+                break;
+            ++n;
+        }
+        deferred.erase(deferred.begin(), deferred.begin() + n);
+        all = all && deferred.empty();
+    }
+    return all;
+}
+
+static bool has_deferred(const std::vector<conn_handle> deferred[PRIORITY_COUNT]){
+    for(int p = 0; p < PRIORITY_COUNT; ++p){
+        if(!deferred[p].empty())
+            return true;
+    }
+    return false;
+}
+
+void server::run_reactor(reactor& r){
+    Poller& ew = *r.poller;
+    while(!stop.load(std::memory_order_acquire)){
+        int timeout = r.wheel.next_timeout(TimingWheel::now_ms());
+        if(has_deferred(r.deferred)){
+            // 不再 accept 新连接, 只等工作线程腾出队列空间
+            if(timeout < 0 || timeout > DEFERRED_RETRY_MS)
+                timeout = DEFERRED_RETRY_MS;
+        }
+        else if(r.accept_pending || r.qt_accept_pending)
+            timeout = 0;
+        if(r.id == 0 && opts_.stats_interval_ms > 0){
+            uint64_t now = TimingWheel::now_ms();
+            if(now >= r.next_report){
+                report_backpressure(r);
+                r.next_report = now + opts_.stats_interval_ms;
+            }
+            int until = (int)(r.next_report - now);
+            if(timeout < 0 || timeout > until)
+                timeout = until;
+        }
+        int num_of_events = ew.wait(timeout);
         auto events_ = ew.get_events();
         for(int i = 0; i < num_of_events; ++i){
 
-            void* ptr = events_[i].data.ptr;
+            conn_handle h = events_[i].data.u64;
             uint32_t ev = events_[i].events;
 
             // listen socket
-            if(((connection*)ptr)->fd == http_listen_sock_){
+            if(h == make_handle(r.http_listen_sock_, 0)){
                 if(ev & EPOLLIN){
-                    struct sockaddr_in client_addr;
-                    socklen_t client_len = sizeof(client_addr);
-                    int connfd = accept(http_listen_sock_, (struct sockaddr*)&client_addr, &client_len);
-                    if(connfd >= 0){
-                        set_nonblocking(connfd);
-                        //std::cout << "accept fd = " << connfd << std::endl;
-                        auto conn = std::make_shared<connection>(connfd, HTTP);
-                        connections[connfd] = conn;
-                        //connection* http_conn = new connection(connfd, HTTP);
-                        ew.add_fd(conn.get(), connfd, EPOLLONESHOT | EPOLLIN | EPOLLERR | EPOLLRDHUP | EPOLLHUP | EPOLLET);
-                    }
+                    // 先处理本轮的其他事件, 循环末尾再 accept
+                    r.accept_pending = true;
                     continue;
                 }
                 else{
                     throw std::runtime_error("listen socket error");
                 }
             }
-            else if(((connection*)ptr)->fd == event_fd){
-                std::cout << "\n[INFO] CTRL+C detected, shutting down server...\n";
+            else if(h == make_handle(event_fd_, 0)){
+                if(!stop.exchange(true))
+                    std::cout << "\n[INFO] CTRL+C detected, shutting down server...\n";
                 end();
             }
+            else if(h == make_handle(qt_listen_sock_, 0)){
+                if(ev & EPOLLIN)
+                    r.qt_accept_pending = true;
+                continue;
+            }
+            else if(asset_cache.enabled() && h == make_handle(asset_cache.notify_fd(), 0)){
+                asset_cache.handle_events();
+                continue;
+            }
             // othre sockets
             else{
-                if(ev & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
-                    int fd = ((connection*)ptr)->fd;
-                    if(((connection*)ptr)->conn_type == WEBSOCKET){
-                        user_to_connection.erase(fd_to_user[((connection*)ptr)->fd]);
-                        fd_to_user.erase(((connection*)ptr)->fd);
-                    }
-                    //std::cout << "[INFO] Connection closed by client: " << ((connection*)ptr)->fd << std::endl;
-                    connections.erase(fd);
-                    close(fd);
-                    ew.del_fd(fd);
-                    //delete (connection*)ptr;
+                // 连接已关闭或 fd 已被新连接复用时句柄失效, 丢弃过期事件
+                conn_ref conn(connections, h);
+                if(!conn)
+                    continue;
+                // 对端半关闭 (EPOLLRDHUP) 时 EPOLLIN 也会置位, 仍然派发任务: 先处理已经收到的请求,
+                // 任务读到 EOF 后关闭写端, 输出发完时两个方向都已关闭, 由 EPOLLHUP 关闭连接
+                if(ev & (EPOLLHUP | EPOLLERR)){
+                    close_connection(r, conn.get());
+                    continue;
                 }
-                else if(ev & EPOLLIN){
-                    switch (((connection*)ptr)->conn_type)
-                    {
-                    case HTTP:
-                        thread_pool.add_task(http_response, ptr, std::ref(ew));
-                        break;
-                    case WEBSOCKET:
-                        thread_pool.add_task(websocket_response, ptr, std::ref(ew));
-                        break;
-                    default:
-                        break;
-                    }
+                // 发送在 reactor 中完成, 同时可读时由随后的任务重新注册
+                if((ev & EPOLLOUT) && !conn->on_writable(!(ev & EPOLLIN))){
+                    close_connection(r, conn.get());
+                    continue;
+                }
+                // 新数据可能开始一个请求, 它的 header 期限不早于现在加 header 超时, 定时器不能比这更晚
+                // 期限由任务设置, 定时器到期时没到期限会按期限重新调度
+                if((ev & EPOLLIN) && conn->conn_type == HTTP && conn_timeouts.header_ms)
+                    r.wheel.schedule_no_later(&conn->timer, TimingWheel::now_ms(), conn_timeouts.header_ms);
+                if((ev & EPOLLIN) && conn->begin_task()){
+                    // 任务只带句柄, 开始执行时再校验
+                    // 聊天帧和控制消息很短且对延迟敏感, 不排在静态文件等 HTTP 请求后面
+                    if(conn->conn_type == WEBSOCKET || conn->conn_type == QT)
+                        dispatch(r, h, PRIORITY_HIGH);
+                    else if(conn->conn_type == HTTP)
+                        dispatch(r, h, PRIORITY_NORMAL);
+                    else
+                        conn->end_task();
                 }
                 continue;
             }
         }
-    }
 
-    delete hl;
-    delete ql;
-    return 0;
-}
\ No newline at end of file
+        // 线程池积压时停止 accept, 新连接留在内核的监听队列中, 由 backlog 向客户端施加背压
+        if(!has_deferred(r.deferred) || retry_deferred(r)){
+            if(r.accept_pending)
+                r.accept_pending = !accept_connections(r, r.http_listen_sock_, HTTP, r.multishot_accept);
+            if(r.qt_accept_pending)
+                r.qt_accept_pending = !accept_connections(r, qt_listen_sock_, QT, false);
+        }
+
+        r.wheel.advance(TimingWheel::now_ms(), [this, &r](timer_node* t){ on_timeout(r, (connection*)t->data); });
+    }
+}
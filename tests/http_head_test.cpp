@@ -0,0 +1,98 @@
+// HEAD 请求和 405 的端到端测试, 需要已经运行的服务器
+// 用法: http_head_test <ip> <port>
+// 所有请求在一个 keep-alive 连接上流水线发出, 响应体被去掉时下一个响应紧跟在头部之后
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+static sockaddr_in server_addr;
+static int failures = 0;
+
+static void check(bool ok, const std::string& what){
+    printf("[%s] %s\n", ok ? "PASS" : "FAIL", what.c_str());
+    if(!ok)
+        ++failures;
+}
+
+struct response{
+    std::string head;
+    size_t content_length = 0;
+};
+
+// 按请求的方法切分响应: HEAD 的响应只有头部, 其余按 Content-Length 跳过响应体
+static std::vector<response> split_responses(const std::string& data, const std::vector<bool>& head_only){
+    std::vector<response> out;
+    size_t pos = 0;
+    for(bool head : head_only){
+        size_t end = data.find("\r\n\r\n", pos);
+        if(end == std::string::npos)
+            break;
+        response r;
+        r.head = data.substr(pos, end + 4 - pos);
+        size_t cl = r.head.find("Content-Length: ");
+        if(cl != std::string::npos)
+            r.content_length = strtoul(r.head.c_str() + cl + 16, nullptr, 10);
+        pos = end + 4 + (head ? 0 : r.content_length);
+        out.push_back(r);
+    }
+    check(pos == data.size(), "no bytes left after the last response");
+    return out;
+}
+
+static bool has(const response& r, const std::string& s){
+    return r.head.find(s) != std::string::npos;
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 3){
+        fprintf(stderr, "usage: %s <ip> <port>\n", argv[0]);
+        return 1;
+    }
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(atoi(argv[2]));
+    inet_aton(argv[1], &server_addr.sin_addr);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (sockaddr*)&server_addr, sizeof(server_addr)) < 0){
+        perror("[ERROR] connect failed");
+        return 1;
+    }
+    std::string requests =
+        "HEAD / HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n"
+        "HEAD / HTTP/1.1\r\nHost: x\r\nAccept-Encoding: gzip\r\nConnection: keep-alive\r\n\r\n"
+        "HEAD /no-such-page HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n"
+        "HEAD /login HTTP/1.1\r\nHost: x\r\nConnection: keep-alive\r\n\r\n"
+        "POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n"
+        "GET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+    std::vector<bool> head_only = {true, true, true, true, false, false};
+    send(fd, requests.data(), requests.size(), MSG_NOSIGNAL);
+
+    std::string data;
+    char buf[16384];
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while(poll(&pfd, 1, 2000) > 0){
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if(n <= 0)
+            break;
+        data.append(buf, n);
+    }
+    close(fd);
+
+    std::vector<response> r = split_responses(data, head_only);
+    check(r.size() == head_only.size(), "one response per request");
+    if(r.size() != head_only.size())
+        return 1;
+    check(has(r[0], "HTTP/1.1 200") && r[0].content_length > 0, "HEAD / is 200 with the GET Content-Length");
+    check(has(r[1], "HTTP/1.1 200") && has(r[1], "Content-Encoding: gzip"), "HEAD / with gzip is 200 without a body");
+    check(has(r[2], "HTTP/1.1 404") && r[2].content_length > 0, "HEAD of a missing page is 404 without a body");
+    check(has(r[3], "HTTP/1.1 405") && has(r[3], "Allow: POST\r\n"), "HEAD /login is 405 with Allow: POST");
+    check(has(r[4], "HTTP/1.1 405") && has(r[4], "Allow: GET, HEAD\r\n"), "POST / is 405 with Allow: GET, HEAD");
+    check(has(r[5], "HTTP/1.1 200") && r[5].content_length == r[0].content_length, "GET / matches the HEAD Content-Length");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+// 持久连接判断的端到端测试, 需要已经运行的服务器
+// 用法: http_pipeline_test <ip> <port>
+// HTTP/1.1 缺省保持连接, Connection 选项不区分大小写, HTTP/1.0 只有带 keep-alive 时才保持
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+static sockaddr_in server_addr;
+static int failures = 0;
+
+static void check(bool ok, const std::string& what){
+    printf("[%s] %s\n", ok ? "PASS" : "FAIL", what.c_str());
+    if(!ok)
+        ++failures;
+}
+
+struct exchange{
+    size_t responses = 0;
+    bool closed = false;
+    std::string status;     // 第一个响应的状态行
+};
+
+// 流水线发出 requests, 按 Content-Length 数出完整的响应; 服务器关闭连接时 closed 为 true
+// half_close 时发完请求就关闭写端
+static exchange run(const std::string& requests, bool half_close = false){
+    exchange ex;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (sockaddr*)&server_addr, sizeof(server_addr)) < 0){
+        perror("[ERROR] connect failed");
+        if(fd >= 0)
+            close(fd);
+        return ex;
+    }
+    send(fd, requests.data(), requests.size(), MSG_NOSIGNAL);
+    if(half_close)
+        shutdown(fd, SHUT_WR);
+
+    std::string data;
+    char buf[16384];
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while(poll(&pfd, 1, 1000) > 0){
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if(n <= 0){
+            ex.closed = true;
+            break;
+        }
+        data.append(buf, n);
+    }
+    close(fd);
+    ex.status = data.substr(0, data.find("\r\n"));
+
+    size_t pos = 0;
+    while(true){
+        size_t end = data.find("\r\n\r\n", pos);
+        if(end == std::string::npos)
+            break;
+        size_t length = 0;
+        size_t cl = data.find("Content-Length: ", pos);
+        if(cl != std::string::npos && cl < end)
+            length = strtoul(data.c_str() + cl + 16, nullptr, 10);
+        if(end + 4 + length > data.size())
+            break;
+        pos = end + 4 + length;
+        ++ex.responses;
+    }
+    return ex;
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 3){
+        fprintf(stderr, "usage: %s <ip> <port>\n", argv[0]);
+        return 1;
+    }
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(atoi(argv[2]));
+    inet_aton(argv[1], &server_addr.sin_addr);
+
+    exchange ex = run(
+        "GET /favicon.ico HTTP/1.1\r\nHost: x\r\n\r\n"
+        "GET /favicon.ico HTTP/1.1\r\nHost: x\r\n\r\n");
+    check(ex.responses == 2 && !ex.closed, "HTTP/1.1 without Connection answers every pipelined request and stays open");
+
+    ex = run(
+        "GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n"
+        "GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n");
+    check(ex.responses == 2 && !ex.closed, "HTTP/1.0 with Connection: Keep-Alive stays open");
+
+    ex = run(
+        "GET / HTTP/1.0\r\n\r\n"
+        "GET / HTTP/1.0\r\n\r\n");
+    check(ex.responses == 1 && ex.closed, "HTTP/1.0 without keep-alive is closed after one response");
+
+    ex = run(
+        "GET / HTTP/1.1\r\nHost: x\r\nConnection: Close\r\n\r\n"
+        "GET / HTTP/1.1\r\nHost: x\r\n\r\n");
+    check(ex.responses == 1 && ex.closed, "HTTP/1.1 with Connection: Close is closed after one response");
+
+    // 升级被拒绝 (缺少 user 返回 400) 时后面的请求照常处理
+    ex = run(
+        "GET /upgrade HTTP/1.1\r\nHost: x\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n"
+        "GET / HTTP/1.1\r\nHost: x\r\n\r\n");
+    check(ex.responses == 2 && !ex.closed, "a refused upgrade does not stall the requests behind it");
+
+    // 对端发完请求后半关闭, 已经收到的请求仍然全部响应
+    ex = run(
+        "GET / HTTP/1.1\r\nHost: x\r\n\r\n"
+        "GET /favicon.ico HTTP/1.1\r\nHost: x\r\n\r\n", true);
+    check(ex.responses == 2 && ex.closed, "requests followed by a half-close are all answered");
+
+    // 超长的头部和请求体在读完之前就被拒绝, 服务器不会一直缓冲
+    ex = run("GET / HTTP/1.1\r\nHost: x\r\nX-Pad: " + std::string(128 * 1024, 'a'));
+    check(ex.status == "HTTP/1.1 431 Request Header Fields Too Large" && ex.closed, "an oversized header is rejected with 431");
+    ex = run("POST /login HTTP/1.1\r\nHost: x\r\nContent-Length: 99999999\r\n\r\n" + std::string(64 * 1024, 'b'));
+    check(ex.status == "HTTP/1.1 413 Payload Too Large" && ex.closed, "an oversized body is rejected with 413");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+// header 超时的端到端测试, 需要已经运行的服务器
+// 用法: http_timeout_test <ip> <port> [header_timeout_ms], 服务器以 header_timeout=<同样的值> 启动 (make test 为 1000)
+// 1. 发出半个请求后不再发送的连接在期限后被关闭
+// 2. 逐字节慢慢发送 (slowloris) 不会推迟期限
+// 3. 完整请求之后的 keep-alive 空闲不受 header 超时限制
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+static sockaddr_in server_addr;
+static int failures = 0;
+static int header_timeout = 1000;
+
+static void check(bool ok, const std::string& what){
+    printf("[%s] %s\n", ok ? "PASS" : "FAIL", what.c_str());
+    if(!ok)
+        ++failures;
+}
+
+static long now_ms(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int connect_server(){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (sockaddr*)&server_addr, sizeof(server_addr)) < 0){
+        perror("[ERROR] connect failed");
+        exit(1);
+    }
+    return fd;
+}
+
+// 等待服务器关闭连接, 最多 timeout_ms; 关闭时返回 true
+static bool closed_within(int fd, int timeout_ms){
+    long end = now_ms() + timeout_ms;
+    while(true){
+        long left = end - now_ms();
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if(left <= 0 || poll(&pfd, 1, (int)left) <= 0)
+            return false;
+        char buf[4096];
+        if(recv(fd, buf, sizeof(buf), 0) <= 0)
+            return true;
+    }
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 3){
+        fprintf(stderr, "usage: %s <ip> <port> [header_timeout_ms]\n", argv[0]);
+        return 1;
+    }
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(atoi(argv[2]));
+    inet_aton(argv[1], &server_addr.sin_addr);
+    if(argc > 3)
+        header_timeout = atoi(argv[3]);
+    // 时间轮的 tick 和调度带来的误差
+    const int slack = 500;
+
+    std::string partial = "GET / HTTP/1.1\r\nHost: x\r\n";
+
+    int fd = connect_server();
+    send(fd, partial.data(), partial.size(), MSG_NOSIGNAL);
+    check(closed_within(fd, header_timeout + slack), "a silent partial request is closed after the header timeout");
+    close(fd);
+
+    // 每 header_timeout / 4 发送一个字节, 持续三倍的期限
+    fd = connect_server();
+    send(fd, partial.data(), partial.size(), MSG_NOSIGNAL);
+    long start = now_ms();
+    bool closed = false;
+    while(!closed && now_ms() - start < 3 * header_timeout){
+        send(fd, "X", 1, MSG_NOSIGNAL);
+        closed = closed_within(fd, header_timeout / 4);
+    }
+    check(closed && now_ms() - start <= header_timeout + slack, "trickled bytes do not extend the header timeout");
+    close(fd);
+
+    fd = connect_server();
+    std::string request = "GET /favicon.ico HTTP/1.1\r\nHost: x\r\n\r\n";
+    send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+    bool answered = false;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    char buf[65536];
+    if(poll(&pfd, 1, 2000) > 0)
+        answered = recv(fd, buf, sizeof(buf), 0) > 0;
+    check(answered && !closed_within(fd, header_timeout + slack), "an idle keep-alive connection outlives the header timeout");
+    close(fd);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+// WebSocket 升级的端到端测试, 需要已经运行的服务器
+// 用法: websocket_test <ip> <port>
+// 1. 升级请求和第一个帧在同一次 write 中发出, 帧必须被转发
+// 2. 一次 write 中的多个帧必须全部被转发
+// 3. 之后单独发出的帧照常转发
+// 4. ping 得到负载相同的 pong, 分片的消息拼接后转发, 超过上限的帧导致连接关闭
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+static sockaddr_in server_addr;
+static int failures = 0;
+
+static void check(bool ok, const char* what){
+    printf("[%s] %s\n", ok ? "PASS" : "FAIL", what);
+    if(!ok)
+        ++failures;
+}
+
+static bool send_all(int fd, const std::string& data){
+    size_t off = 0;
+    while(off < data.size()){
+        ssize_t n = send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if(n <= 0)
+            return false;
+        off += n;
+    }
+    return true;
+}
+
+// 读到 expect 出现或超时
+static bool read_until(int fd, std::string& buf, const std::string& expect, int timeout_ms = 2000){
+    while(buf.find(expect) == std::string::npos){
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if(poll(&pfd, 1, timeout_ms) <= 0)
+            return false;
+        char tmp[4096];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if(n <= 0)
+            return false;
+        buf.append(tmp, n);
+    }
+    return true;
+}
+
+// 服务器关闭写端时返回 true, 超时返回 false
+static bool wait_eof(int fd, int timeout_ms = 2000){
+    while(true){
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if(poll(&pfd, 1, timeout_ms) <= 0)
+            return false;
+        char tmp[4096];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if(n <= 0)
+            return true;
+    }
+}
+
+static std::string upgrade_request(const std::string& user){
+    return "GET /upgrade?user=" + user + " HTTP/1.1\r\n"
+           "Host: localhost\r\n"
+           "Upgrade: websocket\r\n"
+           "Connection: Upgrade\r\n"
+           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+           "Sec-WebSocket-Version: 13\r\n"
+           "\r\n";
+}
+
+// 客户端到服务器的帧必须带掩码
+static std::string client_frame(const std::string& msg, uint8_t opcode = 0x1, bool fin = true){
+    const char mask[4] = {'a', 'b', 'c', 'd'};
+    std::string frame;
+    frame += (char)((fin ? 0x80 : 0) | opcode);
+    if(msg.size() <= 125){
+        frame += (char)(0x80 | msg.size());
+    }
+    else{
+        frame += (char)(0x80 | 127);
+        for(int i = 7; i >= 0; --i)
+            frame += (char)((uint64_t)msg.size() >> (8 * i));
+    }
+    frame.append(mask, 4);
+    for(size_t i = 0; i < msg.size(); ++i)
+        frame += (char)(msg[i] ^ mask[i % 4]);
+    return frame;
+}
+
+static int connect_user(const std::string& user, const std::string& extra){
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0 || connect(fd, (sockaddr*)&server_addr, sizeof(server_addr)) < 0){
+        perror("[ERROR] connect failed");
+        exit(1);
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    std::string buf;
+    if(!send_all(fd, upgrade_request(user) + extra) || !read_until(fd, buf, "\r\n\r\n")){
+        fprintf(stderr, "[ERROR] upgrade failed for %s\n", user.c_str());
+        exit(1);
+    }
+    return fd;
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 3){
+        fprintf(stderr, "usage: %s <ip> <port>\n", argv[0]);
+        return 1;
+    }
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(atoi(argv[2]));
+    inet_aton(argv[1], &server_addr.sin_addr);
+
+    int alice = connect_user("ws_alice", "");
+    std::string alice_buf;
+
+    int bob = connect_user("ws_bob", client_frame("same-segment"));
+    check(read_until(alice, alice_buf, "ws_bob: same-segment"), "frame sent with the upgrade request is broadcast");
+
+    send_all(bob, client_frame("first") + client_frame("second"));
+    check(read_until(alice, alice_buf, "ws_bob: first") && read_until(alice, alice_buf, "ws_bob: second"),
+          "every frame of one write is broadcast");
+
+    send_all(bob, client_frame("later"));
+    check(read_until(alice, alice_buf, "ws_bob: later"), "frame sent later is broadcast");
+
+    std::string bob_buf;
+    send_all(bob, client_frame("are you there", 0x9));
+    check(read_until(bob, bob_buf, std::string("\x8a\x0d") + "are you there"), "ping is answered with a pong carrying the same payload");
+
+    // 分片之间夹着的控制帧照常处理
+    send_all(bob, client_frame("frag", 0x1, false) + client_frame("ping", 0x9) + client_frame("mented", 0x0, true));
+    check(read_until(alice, alice_buf, "ws_bob: fragmented"), "a fragmented message is reassembled and broadcast");
+
+    // 超过负载上限的帧只看帧头就被拒绝, 不等负载读完
+    send_all(bob, client_frame(std::string(2 * 1024 * 1024, 'x')).substr(0, 64 * 1024));
+    check(wait_eof(bob), "an oversized frame closes the connection");
+
+    close(alice);
+    close(bob);
+    return failures == 0 ? 0 : 1;
+}